@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+#
+#  This file is part of spinnaker-adapters
+#
+#  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+#
+#  libneurosim is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  libneurosim is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""End-to-end benchmark of spinnmusic-in and spinnmusic-out.
+
+Each run connects one adapter to tools/spinnemu.py and to a MUSIC
+eventsource or eventlogger, as in examples/send and examples/receive:
+
+  in:   spinnemu -> spinnmusic-in -> eventlogger
+  out:  eventsource -> spinnmusic-out -> spinnemu
+
+The sweep covers spike rate, population size, --timestep,
+--maxbuffered and, for spinnmusic-out, the --sync interval.  One CSV
+line is written per run:
+
+  direction,n,rate_hz,timestep,maxbuffered,sync,duration_s,
+  offered,delivered,spikes_per_s,drop_rate,
+  p50_us,p90_us,p99_us,p999_us,max_us,cpu_s,cpu_pct
+
+offered is the number of spikes fed into the adapter, delivered the
+number which came out at the other end (as logged by eventlogger for
+spinnmusic-in).  Latencies are taken from the adapter's --latency
+histograms (receive for spinnmusic-in, send for spinnmusic-out) and
+CPU time from its own report.
+"""
+
+import argparse
+import itertools
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+COLUMNS = ["direction", "n", "rate_hz", "timestep", "maxbuffered", "sync",
+           "duration_s", "offered", "delivered", "spikes_per_s", "drop_rate",
+           "p50_us", "p90_us", "p99_us", "p999_us", "max_us",
+           "cpu_s", "cpu_pct"]
+
+LABEL = "bench"
+NOTIFY_PORT = 19999
+
+# The emulator keeps running a little longer than MUSIC so that the
+# adapters stop at MUSIC's stoptime rather than on the stop message
+EMULATOR_EXTRA = 0.5
+
+RECEIVE_CONFIG = """stoptime={duration}
+
+[spinn]
+  np=1
+  binary={bindir}/spinnmusic-in
+  args=-l {label} -r {n} --port {port} -t {timestep} -b {maxbuffered} -T {latency}
+
+[logger]
+  np=1
+  binary={eventlogger}
+
+spinn.out->logger.in [{n}]
+"""
+
+SEND_CONFIG = """stoptime={duration}
+
+[source]
+  np=1
+  binary={eventsource}
+  args=-b 1 {n} {spikes}
+
+[spinn]
+  np=1
+  binary={bindir}/spinnmusic-out
+  args=-l {label} -r {n} --port {port} -t {timestep} -b {maxbuffered} -s {sync} -T {latency}
+
+source.out->spinn.in [{n}]
+"""
+
+
+def log(msg):
+    sys.stderr.write("BENCH: " + msg + "\n")
+
+
+def floats(s):
+    return [float(x) for x in s.split(",")]
+
+
+def ints(s):
+    return [int(x) for x in s.split(",")]
+
+
+def write_spikes(path, n, rate, duration):
+    """Write Poisson spike trains in eventsource format, sorted by time."""
+    spikes = []
+    for i in range(n):
+        t = random.expovariate(rate) if rate > 0 else duration
+        while t < duration:
+            spikes.append((t, i))
+            t += random.expovariate(rate)
+    spikes.sort()
+    with open(path, "w") as f:
+        for t, i in spikes:
+            f.write("%.6f\t%d\n" % (t, i))
+    return len(spikes)
+
+
+def latency_summary(path, name):
+    """Return the summary fields of histogram name in a latency file."""
+    fields = {}
+    try:
+        with open(path) as f:
+            for line in f:
+                if line.startswith("# " + name + ":"):
+                    for item in line.split()[2:]:
+                        key, value = item.split("=")
+                        fields[key] = float(value)
+    except IOError:
+        pass
+    return fields
+
+
+def count_events(path):
+    """Return the number of spikes logged in eventlogger output."""
+    pattern = re.compile(r"^\d+: Event \(")
+    with open(path) as f:
+        return sum(1 for line in f if pattern.match(line))
+
+
+def grep_sum(pattern, text):
+    return sum(int(m) for m in re.findall(pattern, text))
+
+
+def grep_float(pattern, text):
+    m = re.search(pattern, text)
+    return float(m.group(1)) if m else 0.0
+
+
+class Bench(object):
+    def __init__(self, args):
+        self.args = args
+
+    def launch(self, config, workdir, np, stdout=subprocess.DEVNULL):
+        command = self.args.mpirun.split() + ["-np", str(np),
+                                              self.args.music, config]
+        return subprocess.Popen(command, cwd=workdir,
+                                stdout=stdout,
+                                stderr=subprocess.PIPE,
+                                universal_newlines=True)
+
+    def emulator(self, n, rate, duration):
+        command = [sys.executable, self.args.emulator,
+                   "--port", str(NOTIFY_PORT),
+                   "--population", "%s:%d" % (LABEL, n),
+                   "--rate", str(rate),
+                   "--duration", str(duration + EMULATOR_EXTRA),
+                   "--timeout", str(self.args.timeout)]
+        if self.args.seed is not None:
+            command += ["--seed", str(self.args.seed)]
+        return subprocess.Popen(command, stdout=subprocess.DEVNULL,
+                                stderr=subprocess.PIPE,
+                                universal_newlines=True)
+
+    def run(self, direction, n, rate, timestep, maxbuffered, sync):
+        args = self.args
+        duration = args.duration
+        workdir = tempfile.mkdtemp(prefix="spinnbench-")
+        latency = os.path.join(workdir, "latency.csv")
+        config = os.path.join(workdir, "bench.music")
+        params = dict(duration=duration, bindir=args.bindir, label=LABEL,
+                      n=n, port=NOTIFY_PORT, timestep=timestep,
+                      maxbuffered=maxbuffered, sync=sync, latency=latency,
+                      eventsource=args.eventsource,
+                      eventlogger=args.eventlogger, spikes="spikes")
+        try:
+            if direction == "in":
+                with open(config, "w") as f:
+                    f.write(RECEIVE_CONFIG.format(**params))
+                emulator = self.emulator(n, rate, duration)
+            else:
+                offered = write_spikes(os.path.join(workdir, "spikes0.dat"),
+                                       n, rate, duration)
+                with open(config, "w") as f:
+                    f.write(SEND_CONFIG.format(**params))
+                emulator = self.emulator(n, 0.0, duration)
+            # eventlogger prints the spikes it receives
+            events = os.path.join(workdir, "events.txt")
+            with open(events, "w") as f:
+                music = self.launch(config, workdir, 2, f)
+            try:
+                _, adapter_log = music.communicate(
+                    timeout=duration + args.timeout)
+                _, emulator_log = emulator.communicate(
+                    timeout=EMULATOR_EXTRA + args.timeout)
+            except subprocess.TimeoutExpired:
+                music.kill()
+                emulator.kill()
+                raise RuntimeError("run timed out")
+            if music.returncode != 0:
+                raise RuntimeError("music exited with status %d:\n%s"
+                                   % (music.returncode, adapter_log))
+
+            if direction == "in":
+                # Spikes emitted during the extra time never reach MUSIC
+                emitted = grep_sum(r"emitted (\d+) spikes", emulator_log)
+                offered = int(round(emitted * duration
+                                    / (duration + EMULATOR_EXTRA)))
+                delivered = count_events(events)
+                histogram = "receive"
+            else:
+                delivered = grep_sum(r"injected (\d+) spikes", emulator_log)
+                histogram = "send"
+            summary = latency_summary(latency, histogram)
+            cpu = grep_float(r"used ([0-9.e+-]+) s CPU time", adapter_log)
+        finally:
+            if not args.keep:
+                shutil.rmtree(workdir, ignore_errors=True)
+            else:
+                log("kept " + workdir)
+
+        drop = 1.0 - float(delivered) / offered if offered > 0 else 0.0
+        return [direction, n, rate, timestep, maxbuffered, sync, duration,
+                offered, delivered,
+                "%.1f" % (delivered / duration),
+                "%.6f" % max(drop, 0.0),
+                "%.1f" % (1e-3 * summary.get("p50_ns", 0.0)),
+                "%.1f" % (1e-3 * summary.get("p90_ns", 0.0)),
+                "%.1f" % (1e-3 * summary.get("p99_ns", 0.0)),
+                "%.1f" % (1e-3 * summary.get("p99.9_ns", 0.0)),
+                "%.1f" % (1e-3 * summary.get("max_ns", 0.0)),
+                "%.3f" % cpu,
+                "%.1f" % (100.0 * cpu / duration)]
+
+    def sweep(self):
+        args = self.args
+        out = open(args.output, "w") if args.output != "-" else sys.stdout
+        out.write(",".join(COLUMNS) + "\n")
+        out.flush()
+        failures = 0
+        for direction in args.direction.split(","):
+            # The sync protocol only exists in spinnmusic-out
+            syncs = args.sync if direction == "out" else [0.0]
+            for n, rate, timestep, maxbuffered, sync in itertools.product(
+                    args.sizes, args.rates, args.timesteps,
+                    args.maxbuffered, syncs):
+                log("%s n=%d rate=%g timestep=%g maxbuffered=%d sync=%g"
+                    % (direction, n, rate, timestep, maxbuffered, sync))
+                try:
+                    row = self.run(direction, n, rate, timestep,
+                                   maxbuffered, sync)
+                except (RuntimeError, OSError) as e:
+                    log("failed: %s" % e)
+                    failures += 1
+                    continue
+                out.write(",".join(str(x) for x in row) + "\n")
+                out.flush()
+                # Let the ports of the previous run go
+                time.sleep(args.pause)
+        if out is not sys.stdout:
+            out.close()
+            log("results in " + args.output)
+        return failures
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(
+        description="Sweep spinnmusic-in/out against the board emulator")
+    parser.add_argument("--bindir", default=os.path.join(here, "..", "src"),
+                        help="directory holding spinnmusic-in and "
+                        "spinnmusic-out (default ../src)")
+    parser.add_argument("--emulator",
+                        default=os.path.join(here, "..", "tools",
+                                             "spinnemu.py"),
+                        help="board emulator script")
+    parser.add_argument("--music", default="music",
+                        help="MUSIC launcher (default music)")
+    parser.add_argument("--mpirun", default="mpirun",
+                        help="MPI launcher command (default mpirun)")
+    parser.add_argument("--eventsource", default="eventsource")
+    parser.add_argument("--eventlogger", default="eventlogger")
+    parser.add_argument("--direction", default="in,out",
+                        help="in, out or in,out (default in,out)")
+    parser.add_argument("--rates", type=floats, default=[10.0, 100.0],
+                        help="spike rates per neuron in Hz (default 10,100)")
+    parser.add_argument("--sizes", type=ints, default=[100, 1000],
+                        help="population sizes (default 100,1000)")
+    parser.add_argument("--timesteps", type=floats, default=[1e-3, 1e-2],
+                        help="adapter --timestep values (default 0.001,0.01)")
+    parser.add_argument("--maxbuffered", type=ints, default=[0, 1],
+                        help="adapter --maxbuffered values (default 0,1)")
+    parser.add_argument("--sync", type=floats, default=[0.0, 0.1],
+                        help="spinnmusic-out --sync intervals, 0 for none "
+                        "(default 0,0.1)")
+    parser.add_argument("--duration", type=float, default=5.0,
+                        help="simulated seconds per run (default 5)")
+    parser.add_argument("--timeout", type=float, default=30.0,
+                        help="seconds to wait beyond the run for startup "
+                        "and shutdown (default 30)")
+    parser.add_argument("--pause", type=float, default=0.5,
+                        help="seconds between runs (default 0.5)")
+    parser.add_argument("-o", "--output", default="bench-results.csv",
+                        help="CSV file, - for stdout "
+                        "(default bench-results.csv)")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the working directory of each run")
+    parser.add_argument("--seed", type=int, help="random seed")
+    args = parser.parse_args()
+    if args.seed is not None:
+        random.seed(args.seed)
+    return 1 if Bench(args).sweep() > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,157 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <algorithm>
+#include "ClockSync.h"
+
+// Fewest samples to fit a line through
+const size_t MIN_SAMPLES = 8;
+
+// Residuals further than this many (normalized) median absolute
+// deviations from the median are outliers
+const double OUTLIER_MADS = 3.0;
+
+
+ClockSync::ClockSync (size_t window)
+  : window_ (std::max (window, MIN_SAMPLES)),
+    haveOrigin_ (false),
+    host0_ (0.0),
+    spinnaker0_ (0.0),
+    slope_ (1.0),
+    intercept_ (0.0),
+    residual_ (0.0)
+{
+  // fit () runs on the tick thread, which shouldn't allocate
+  inliers_.reserve (window_);
+  scratch_.reserve (window_);
+  deviations_.reserve (window_);
+}
+
+
+void
+ClockSync::addSample (double host, double spinnaker)
+{
+  if (!haveOrigin_)
+    {
+      host0_ = host;
+      spinnaker0_ = spinnaker;
+      intercept_ = spinnaker;
+      haveOrigin_ = true;
+    }
+  Sample s = { host - host0_, spinnaker };
+  samples_.push_back (s);
+  if (samples_.size () > window_)
+    samples_.pop_front ();
+}
+
+
+void
+ClockSync::restart ()
+{
+  samples_.clear ();
+  haveOrigin_ = false;
+}
+
+
+void
+ClockSync::leastSquares (const std::vector<Sample>& samples)
+{
+  double n = samples.size ();
+  double mx = 0.0, my = 0.0;
+  for (size_t i = 0; i < samples.size (); ++i)
+    {
+      mx += samples[i].host;
+      my += samples[i].spinnaker;
+    }
+  mx /= n;
+  my /= n;
+  double sxx = 0.0, sxy = 0.0;
+  for (size_t i = 0; i < samples.size (); ++i)
+    {
+      double dx = samples[i].host - mx;
+      sxx += dx * dx;
+      sxy += dx * (samples[i].spinnaker - my);
+    }
+  // All samples at the same host time: keep the old slope
+  if (sxx > 0.0)
+    slope_ = sxy / sxx;
+  intercept_ = my - slope_ * mx;
+}
+
+
+bool
+ClockSync::fit ()
+{
+  if (samples_.size () < MIN_SAMPLES)
+    return false;
+
+  inliers_.assign (samples_.begin (), samples_.end ());
+  leastSquares (inliers_);
+
+  // Median and median absolute deviation of residuals
+  scratch_.resize (inliers_.size ());
+  for (size_t i = 0; i < inliers_.size (); ++i)
+    scratch_[i] = inliers_[i].spinnaker
+      - (intercept_ + slope_ * inliers_[i].host);
+  std::vector<double>& r = deviations_;
+  r.assign (scratch_.begin (), scratch_.end ());
+  size_t mid = r.size () / 2;
+  std::nth_element (r.begin (), r.begin () + mid, r.end ());
+  double median = r[mid];
+  for (size_t i = 0; i < r.size (); ++i)
+    r[i] = fabs (scratch_[i] - median);
+  std::nth_element (r.begin (), r.begin () + mid, r.end ());
+  // 1.4826 makes the MAD consistent with the standard deviation;
+  // the constant term protects against a zero MAD
+  double limit = OUTLIER_MADS * 1.4826 * r[mid] + 1e-9;
+
+  size_t j = 0;
+  for (size_t i = 0; i < inliers_.size (); ++i)
+    if (fabs (scratch_[i] - median) <= limit)
+      inliers_[j++] = inliers_[i];
+  inliers_.resize (j);
+  if (j >= 2)
+    leastSquares (inliers_);
+
+  double sum = 0.0;
+  for (size_t i = 0; i < inliers_.size (); ++i)
+    {
+      double e = inliers_[i].spinnaker
+	- (intercept_ + slope_ * inliers_[i].host);
+      sum += e * e;
+    }
+  residual_ = inliers_.empty () ? 0.0 : sqrt (sum / inliers_.size ());
+  return true;
+}
+
+
+double
+ClockSync::estimate (double host) const
+{
+  return intercept_ + slope_ * (host - host0_);
+}
+
+
+double
+ClockSync::offset (double host) const
+{
+  return estimate (host) - spinnaker0_ - (host - host0_);
+}
@@ -0,0 +1,105 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+/**
+ * Estimate SpiNNaker time as a linear function of host time.
+ *
+ * Samples pair the host time at which a packet arrived with the
+ * SpiNNaker time stamped in it.  The fit is made over a sliding
+ * window of samples.  Packets are delayed by varying amounts, so
+ * after a first least squares fit, samples with residuals far from
+ * the median are discarded and the line is fitted again.
+ */
+class ClockSync
+{
+ public:
+  ClockSync (size_t window);
+
+  /**
+   * Add a sample.  Times are in seconds.
+   */
+  void addSample (double host, double spinnaker);
+
+  /**
+   * Forget all samples and start over from the next, for when
+   * SpiNNaker has paused and host time has moved on without it.
+   */
+  void restart ();
+
+  /**
+   * Fit the line to the current window.  Return false if there are
+   * too few samples for a fit.
+   */
+  bool fit ();
+
+  /**
+   * Return the estimated SpiNNaker time at the given host time.
+   */
+  double estimate (double host) const;
+
+  /**
+   * Return the relative rate error of the SpiNNaker clock.
+   */
+  double drift () const { return slope_ - 1.0; }
+
+  /**
+   * Return how far SpiNNaker time has drifted from host time since
+   * the first sample, in seconds.
+   */
+  double offset (double host) const;
+
+  /**
+   * Return the RMS residual of the samples used in the last fit.
+   */
+  double residual () const { return residual_; }
+
+  size_t nSamples () const { return samples_.size (); }
+
+ private:
+  struct Sample
+  {
+    double host;		// relative to host0_
+    double spinnaker;
+  };
+
+  void leastSquares (const std::vector<Sample>& samples);
+
+  size_t window_;
+  std::deque<Sample> samples_;
+  bool haveOrigin_;
+  double host0_;
+  double spinnaker0_;
+  double slope_;		// spinnaker = intercept_ + slope_ * host
+  double intercept_;
+  double residual_;
+  // Buffers of fit (), reserved for window_ samples
+  std::vector<Sample> inliers_;
+  std::vector<double> scratch_;	// residuals
+  std::vector<double> deviations_; // reordered by nth_element
+};
+
+#endif /* CLOCKSYNC_H */
@@ -0,0 +1,273 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <stdexcept>
+#include <string>
+#include "EventLoop.h"
+
+static sigset_t
+shutdownSignals ()
+{
+  sigset_t signals;
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGTERM);
+  return signals;
+}
+
+
+EventLoop::EventLoop (bool shutdown)
+  : epoll_ (-1), timer_ (-1), event_ (-1), signal_ (-1),
+    notified_ (false), shuttingDown_ (false)
+{
+  try
+    {
+      epoll_ = epoll_create1 (EPOLL_CLOEXEC);
+      timer_ = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      event_ = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (epoll_ < 0 || timer_ < 0 || event_ < 0)
+	throw std::runtime_error (std::string ("failed to create event loop: ")
+				  + strerror (errno));
+      add (timer_);
+      add (event_);
+      if (shutdown)
+	{
+	  sigset_t signals = shutdownSignals ();
+	  signal_ = signalfd (-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	  if (signal_ < 0)
+	    throw std::runtime_error (std::string ("failed to create signalfd: ")
+				      + strerror (errno));
+	  add (signal_);
+	}
+    }
+  catch (std::runtime_error&)
+    {
+      closeAll ();
+      throw;
+    }
+}
+
+
+EventLoop::~EventLoop ()
+{
+  closeAll ();
+}
+
+
+void
+EventLoop::closeAll ()
+{
+  int* fds[] = { &epoll_, &timer_, &event_, &signal_ };
+  for (size_t i = 0; i < sizeof (fds) / sizeof (fds[0]); ++i)
+    if (*fds[i] >= 0)
+      {
+	close (*fds[i]);
+	*fds[i] = -1;
+      }
+}
+
+
+void
+EventLoop::blockShutdownSignals ()
+{
+  sigset_t signals = shutdownSignals ();
+  pthread_sigmask (SIG_BLOCK, &signals, NULL);
+}
+
+
+void
+EventLoop::add (int fd)
+{
+  struct epoll_event event;
+  memset (&event, 0, sizeof (event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl (epoll_, EPOLL_CTL_ADD, fd, &event) != 0)
+    throw std::runtime_error (std::string ("epoll_ctl failed: ")
+			      + strerror (errno));
+}
+
+
+void
+EventLoop::notify ()
+{
+  notified_.store (true, std::memory_order_release);
+  uint64_t one = 1;
+  // Fails only if the counter is about to overflow, and then the
+  // waiting thread will wake anyway
+  ssize_t n = write (event_, &one, sizeof (one));
+  (void) n;
+}
+
+
+int
+EventLoop::wait (NsTime deadline)
+{
+  struct itimerspec spec;
+  memset (&spec, 0, sizeof (spec));
+  spec.it_value = deadline.toTimespec ();
+  // A deadline which has passed expires at once
+  timerfd_settime (timer_, TFD_TIMER_ABSTIME, &spec, NULL);
+  int result = waitEvents (-1);
+  if (!(result & TIMEOUT))
+    {
+      // Disarm, so that a stale expiry can't end the next wait
+      memset (&spec, 0, sizeof (spec));
+      timerfd_settime (timer_, 0, &spec, NULL);
+    }
+  return result;
+}
+
+
+int
+EventLoop::wait ()
+{
+  return waitEvents (-1);
+}
+
+
+int
+EventLoop::poll ()
+{
+  return waitEvents (0) & ~TIMEOUT;
+}
+
+
+int
+EventLoop::waitEvents (int timeout)
+{
+  const int MAX_EVENTS = 3;
+  struct epoll_event events[MAX_EVENTS];
+  int n;
+  while ((n = epoll_wait (epoll_, events, MAX_EVENTS, timeout)) < 0
+	 && errno == EINTR)
+    ;
+  int result = 0;
+  for (int i = 0; i < n; ++i)
+    {
+      int fd = events[i].data.fd;
+      if (fd == timer_)
+	{
+	  uint64_t expirations;
+	  if (read (timer_, &expirations, sizeof (expirations)) > 0)
+	    result |= TIMEOUT;
+	}
+      else if (fd == event_)
+	{
+	  // Clear the flag first, so that a notify () racing with us
+	  // is seen at the latest by the next wait
+	  notified_.store (false, std::memory_order_release);
+	  uint64_t count;
+	  if (read (event_, &count, sizeof (count)) > 0)
+	    result |= NOTIFIED;
+	}
+      else if (fd == signal_)
+	{
+	  struct signalfd_siginfo info;
+	  while (read (signal_, &info, sizeof (info)) == sizeof (info))
+	    shuttingDown_.store (true, std::memory_order_relaxed);
+	  if (shuttingDown_.load (std::memory_order_relaxed))
+	    result |= SIGNALLED;
+	}
+    }
+  return result;
+}
+
+
+RunControl::RunControl (EventLoop& loop)
+  : loop_ (loop), starts_ (0), stops_ (0), segment_ (0), stopped_ (0),
+    finished_ (false)
+{
+  if (pthread_mutex_init (&mutex_, NULL) != 0)
+    throw std::runtime_error ("failed to initialize run control mutex");
+  if (pthread_cond_init (&condition_, NULL) != 0)
+    throw std::runtime_error ("failed to initialize run control condition");
+}
+
+
+RunControl::~RunControl ()
+{
+  pthread_cond_destroy (&condition_);
+  pthread_mutex_destroy (&mutex_);
+}
+
+
+void
+RunControl::requestStart ()
+{
+  starts_.fetch_add (1, std::memory_order_acq_rel);
+  loop_.notify ();
+}
+
+
+void
+RunControl::requestStop ()
+{
+  // The n:th stop ends segment n
+  unsigned segment = stops_.fetch_add (1, std::memory_order_acq_rel) + 1;
+  loop_.notify ();
+  pthread_mutex_lock (&mutex_);
+  while (stopped_ < segment && !finished_)
+    pthread_cond_wait (&condition_, &mutex_);
+  pthread_mutex_unlock (&mutex_);
+}
+
+
+bool
+RunControl::waitForStart ()
+{
+  while (starts_.load (std::memory_order_acquire) <= segment_)
+    {
+      if (loop_.shuttingDown ())
+	return false;
+      loop_.wait ();
+    }
+  ++segment_;
+  return true;
+}
+
+
+void
+RunControl::stopped ()
+{
+  pthread_mutex_lock (&mutex_);
+  stopped_ = segment_;
+  pthread_cond_broadcast (&condition_);
+  pthread_mutex_unlock (&mutex_);
+}
+
+
+void
+RunControl::finished ()
+{
+  pthread_mutex_lock (&mutex_);
+  finished_ = true;
+  pthread_cond_broadcast (&condition_);
+  pthread_mutex_unlock (&mutex_);
+}
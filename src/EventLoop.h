@@ -0,0 +1,172 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <pthread.h>
+#include <atomic>
+#include "nstime.h"
+
+/**
+ * Blocking waits of one thread on a single epoll set.  The set holds
+ * a timerfd armed at the deadline of the wait, an eventfd through
+ * which other threads wake the waiting thread, and optionally a
+ * signalfd for SIGINT and SIGTERM.
+ */
+class EventLoop
+{
+ public:
+  // What ended a wait, or-ed together
+  enum { TIMEOUT = 1, NOTIFIED = 2, SIGNALLED = 4 };
+
+  /**
+   * With shutdown, also wake on SIGINT and SIGTERM, which must have
+   * been blocked with blockShutdownSignals ().
+   */
+  EventLoop (bool shutdown = false);
+  ~EventLoop ();
+
+  /**
+   * Block SIGINT and SIGTERM in the calling thread and the threads
+   * it creates later, so that an EventLoop receives them.  Call
+   * first thing in main ().
+   */
+  static void blockShutdownSignals ();
+
+  /**
+   * Wake the waiting thread.  Safe to call from any thread.
+   */
+  void notify ();
+
+  /**
+   * Return true if notify () has been called since the last wait.
+   * Cheap enough to call while spinning.
+   */
+  bool notified () const { return notified_.load (std::memory_order_acquire); }
+
+  /**
+   * Return true once a shutdown signal has arrived.
+   */
+  bool shuttingDown () const { return shuttingDown_.load (std::memory_order_relaxed); }
+
+  /**
+   * Wait until the absolute (monotonic) time deadline, a notify () or
+   * a shutdown signal.  Return what ended the wait.
+   */
+  int wait (NsTime deadline);
+
+  /**
+   * Wait for a notify () or a shutdown signal.
+   */
+  int wait ();
+
+  /**
+   * Collect notifications and signals without waiting.  Return 0 if
+   * there were none.
+   */
+  int poll ();
+
+ private:
+  void add (int fd);
+  int waitEvents (int timeout);
+  void closeAll ();
+
+  int epoll_;
+  int timer_;
+  int event_;
+  int signal_;			// -1 unless watching for shutdown
+  std::atomic<bool> notified_;
+  std::atomic<bool> shuttingDown_;
+};
+
+
+/**
+ * Start and stop of the simulation, requested by SpiNNaker callbacks
+ * and carried out by a main loop which waits on an EventLoop.  The
+ * requests are counted, so they can't be lost if they arrive before
+ * the main loop waits for them.  Each start begins a run segment,
+ * which the next stop ends; a main loop may wait for the start of
+ * another segment after a stop.
+ */
+class RunControl
+{
+ public:
+  RunControl (EventLoop& loop);
+  ~RunControl ();
+
+  /**
+   * Called by the start callback
+   */
+  void requestStart ();
+
+  /**
+   * Called by the stop callback.  Return when the main loop has
+   * stopped the current segment, or has finished.
+   */
+  void requestStop ();
+
+  /**
+   * Wait for the start of the next segment.  Return false if a
+   * shutdown signal arrived first.
+   */
+  bool waitForStart ();
+
+  /**
+   * Return true if the main loop should stop the current segment,
+   * either on request or because of a shutdown signal.  Before the
+   * first start (when replaying) only a signal stops it.
+   */
+  bool stopRequested () const
+  {
+    return (segment_ > 0
+	    && stops_.load (std::memory_order_acquire) >= segment_)
+      || loop_.shuttingDown ();
+  }
+
+  /**
+   * Tell requestStop () that the main loop has stopped the current
+   * segment.
+   */
+  void stopped ();
+
+  /**
+   * Tell requestStop () that the main loop has ended, so that no
+   * stop needs to wait any more.
+   */
+  void finished ();
+
+  /**
+   * Return the number of segments started
+   */
+  unsigned segment () const { return segment_; }
+
+ private:
+  EventLoop& loop_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t condition_;
+  std::atomic<unsigned> starts_;
+  std::atomic<unsigned> stops_;
+  unsigned segment_;		// used by the main loop
+  unsigned stopped_;		// segments stopped, protected by mutex_
+  bool finished_;		// protected by mutex_
+};
+
+#endif /* EVENTLOOP_H */
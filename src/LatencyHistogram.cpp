@@ -0,0 +1,152 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <signal.h>
+#include <fstream>
+#include <stdexcept>
+#include "LatencyHistogram.h"
+
+static volatile sig_atomic_t dumpSignalled = 0;
+
+static void
+dumpHandler (int)
+{
+  dumpSignalled = 1;
+}
+
+
+LatencyHistogram::LatencyHistogram (const std::string& name)
+  : name_ (name), count_ (0), early_ (0), sum_ (0), max_ (0)
+{
+  for (int i = 0; i < N_BUCKETS; ++i)
+    counts_[i] = 0;
+}
+
+
+int64_t
+LatencyHistogram::low (int i)
+{
+  if (i < SUB_BUCKETS)
+    return i;
+  int b = i / HALF - 1;
+  return (int64_t) (i - b * HALF) << b;
+}
+
+
+int64_t
+LatencyHistogram::high (int i)
+{
+  if (i < SUB_BUCKETS)
+    return i + 1;
+  int b = i / HALF - 1;
+  return (int64_t) (i - b * HALF + 1) << b;
+}
+
+
+int64_t
+LatencyHistogram::percentile (double p) const
+{
+  uint64_t n = count ();
+  if (n == 0)
+    return 0;
+  uint64_t target = p / 100.0 * n;
+  if (target >= n)
+    target = n - 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < N_BUCKETS; ++i)
+    {
+      seen += counts_[i].load (std::memory_order_relaxed);
+      if (seen > target)
+	return high (i);
+    }
+  return max_.load (std::memory_order_relaxed);
+}
+
+
+void
+LatencyHistogram::write (std::ostream& out) const
+{
+  uint64_t n = count ();
+  out << "# " << name_ << ": count=" << n
+      << " early=" << early_.load (std::memory_order_relaxed)
+      << " mean_ns=" << (n > 0 ? sum_.load (std::memory_order_relaxed) / n : 0)
+      << " p50_ns=" << percentile (50.0)
+      << " p90_ns=" << percentile (90.0)
+      << " p99_ns=" << percentile (99.0)
+      << " p99.9_ns=" << percentile (99.9)
+      << " max_ns=" << max_.load (std::memory_order_relaxed) << '\n';
+  for (int i = 0; i < N_BUCKETS; ++i)
+    {
+      uint64_t c = counts_[i].load (std::memory_order_relaxed);
+      if (c > 0)
+	out << name_ << ',' << low (i) << ',' << high (i) << ',' << c << '\n';
+    }
+}
+
+
+void
+LatencyHistogram::summary (std::ostream& out, const std::string& prefix,
+			   const std::string& what) const
+{
+  out << prefix << name_ << " latency: " << count () << ' ' << what;
+  if (count () > 0)
+    out << ", median " << 1e-3 * percentile (50.0)
+	<< " us, 99% " << 1e-3 * percentile (99.0)
+	<< " us, max " << 1e-3 * max_.load (std::memory_order_relaxed)
+	<< " us";
+  out << '\n';
+}
+
+
+void
+LatencyHistogram::dump (const std::string& file,
+			const std::vector<const LatencyHistogram*>& histograms)
+{
+  std::ofstream out (file.c_str ());
+  if (!out)
+    throw std::runtime_error ("couldn't open " + file);
+  out << "histogram,low_ns,high_ns,count\n";
+  for (std::vector<const LatencyHistogram*>::const_iterator h
+	 = histograms.begin ();
+       h != histograms.end ();
+       ++h)
+    (*h)->write (out);
+}
+
+
+void
+LatencyHistogram::dumpOnSignal (int sig)
+{
+  struct sigaction action;
+  action.sa_handler = dumpHandler;
+  sigemptyset (&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction (sig, &action, NULL);
+}
+
+
+bool
+LatencyHistogram::dumpRequested ()
+{
+  if (!dumpSignalled)
+    return false;
+  dumpSignalled = 0;
+  return true;
+}
@@ -0,0 +1,133 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Log-linear (HDR style) histogram of latencies in nanoseconds.
+ *
+ * Each power of two is divided into SUB_BUCKETS / 2 buckets, giving
+ * a relative resolution of about 3%.  record () is meant to be called
+ * from a single thread, while other threads may read the histogram
+ * at any time.
+ */
+class LatencyHistogram
+{
+ public:
+  static const int SUB_BITS = 6;
+  static const int SUB_BUCKETS = 1 << SUB_BITS;
+  static const int HALF = SUB_BUCKETS / 2;
+  static const int N_BUCKETS = (64 - SUB_BITS + 1) * HALF + HALF;
+
+  LatencyHistogram (const std::string& name);
+
+  const std::string& name () const { return name_; }
+
+  /**
+   * Record n events with latency ns.  Negative latencies are counted
+   * as early and recorded as 0.
+   */
+  void record (int64_t ns, uint64_t n = 1)
+  {
+    if (ns < 0)
+      {
+	bump (early_, n);
+	ns = 0;
+      }
+    bump (counts_[index (ns)], n);
+    bump (count_, n);
+    bump (sum_, n * ns);
+    if (ns > max_.load (std::memory_order_relaxed))
+      max_.store (ns, std::memory_order_relaxed);
+  }
+
+  uint64_t count () const { return count_.load (std::memory_order_relaxed); }
+
+  /**
+   * Return the upper bound of the bucket containing the given
+   * percentile (0-100).
+   */
+  int64_t percentile (double p) const;
+
+  /**
+   * Write the histogram as comma separated lines
+   * name,low_ns,high_ns,count preceded by a comment line starting
+   * with # which summarizes it.
+   */
+  void write (std::ostream& out) const;
+
+  /**
+   * Write one summary line, counting events as what
+   */
+  void summary (std::ostream& out, const std::string& prefix,
+		const std::string& what = "spikes") const;
+
+  /**
+   * Write histograms to file, replacing its contents.
+   */
+  static void dump (const std::string& file,
+		    const std::vector<const LatencyHistogram*>& histograms);
+
+  /**
+   * Request a dump whenever signal sig arrives.
+   */
+  static void dumpOnSignal (int sig);
+
+  /**
+   * Return true once after each signal.
+   */
+  static bool dumpRequested ();
+
+ private:
+  // Only one thread writes, so no atomic read-modify-write is needed
+  static void bump (std::atomic<uint64_t>& c, uint64_t n)
+  {
+    c.store (c.load (std::memory_order_relaxed) + n,
+	     std::memory_order_relaxed);
+  }
+
+  static int index (int64_t ns)
+  {
+    uint64_t v = ns;
+    if (v < (uint64_t) SUB_BUCKETS)
+      return v;
+    int b = 63 - __builtin_clzll (v) - (SUB_BITS - 1);
+    return b * HALF + (v >> b);
+  }
+
+  static int64_t low (int i);
+  static int64_t high (int i);
+
+  std::string name_;
+  std::atomic<uint64_t> counts_[N_BUCKETS];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> early_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<int64_t> max_;
+};
+
+#endif /* LATENCYHISTOGRAM_H */
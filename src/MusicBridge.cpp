@@ -0,0 +1,152 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include "MusicBridge.h"
+
+MusicBridge::MusicBridge (Runtime* runtime_,
+			  MusicOutputAdapter& musicOutput_,
+			  MusicInputAdapter& musicInput_,
+			  double stoptime_,
+			  const ThreadPlacements& placements_,
+			  bool lockPages_)
+  : runtime (runtime_), musicOutput (musicOutput_), musicInput (musicInput_), loop (true), control (loop), stoptime (stoptime_), segments (false), placements (placements_), lockPages (lockPages_)
+{
+}
+
+
+void
+MusicBridge::spikes_start (char *label,
+			   SpynnakerLiveSpikesConnection *connection)
+{
+  std::cerr << "MB: Starting the simulation\n";
+  control.requestStart ();
+  std::cerr << "MB: Start signal sent\n";
+}
+
+
+void
+MusicBridge::spikes_stop (char *label,
+			  SpynnakerLiveSpikesConnection *connection)
+{
+  std::cerr << "MB: Stopping the simulation\n";
+  control.requestStop ();
+}
+
+
+// The adapters allocate their buffers; the tick thread is ours
+void
+MusicBridge::prepareRealtime ()
+{
+  musicOutput.prepareRealtime ();
+  musicInput.prepareRealtime ();
+  if (lockPages)
+    lockMemory ("MB: ");
+  placeThread (placements, "tick", !placements.empty () || lockPages,
+	       "MB: ");
+}
+
+
+// Return false if a shutdown signal arrived first
+bool
+MusicBridge::waitForStart ()
+{
+  std::cerr << "MB: Waiting for start\n";
+  return control.waitForStart ();
+}
+
+
+// Wait for the clock target.  Return false if asked to stop first.
+bool
+MusicBridge::waitForTarget (RTClock& clock)
+{
+  while (!clock.waitForTarget (loop))
+    if (control.stopRequested ())
+      return false;
+  return !control.stopRequested ();
+}
+
+
+// SpiNNaker has paused or stopped, or a shutdown signal arrived.
+// With run segments, hold the clock, queues and MUSIC until the next
+// start.  Return false if the main loop should end.
+bool
+MusicBridge::pause (RTClock& clock)
+{
+  clock.stop ();
+  musicInput.stopSending ();
+  control.stopped ();
+  std::cerr << "MB: Stopped\n";
+  if (!segments || !waitForStart ())
+    return false;
+  musicOutput.resync ();
+  clock.start ();
+  musicOutput.followClock ();
+  musicInput.startSending (clock);
+  return true;
+}
+
+
+void
+MusicBridge::main_loop ()
+{
+  prepareRealtime ();
+  RTClock& clock = musicOutput.tickClock ();
+  clock.resetAndStop ();
+  if (!waitForStart ())
+    {
+      control.finished ();
+      return;
+    }
+  clock.start ();
+  musicOutput.followClock ();
+  musicInput.startSending (clock);
+  while (clock.time () < stoptime)
+    {
+      musicInput.beforeTick (clock);
+      clock.setNextTarget ();
+      // After a pause, the next segment picks up at the same target
+      while (!waitForTarget (clock))
+	if (!pause (clock))
+	  goto stop;
+      // One tick takes the spikes from SpiNNaker to MUSIC and brings
+      // those for SpiNNaker
+      musicOutput.beforeTick ();
+      NsTime before = RTClock::getTime ();
+      runtime->tick ();
+      NsTime blocked = RTClock::getTime () - before;
+      musicOutput.afterTick ();
+      musicInput.afterTick (clock, blocked);
+      // A dump request is seen only once, so serve both adapters
+      if (LatencyHistogram::dumpRequested ())
+	{
+	  musicOutput.dumpLatency ();
+	  musicInput.dumpLatency ();
+	}
+    }
+ stop:
+  musicInput.stopSending ();
+  // A stop request after the end needn't wait
+  control.finished ();
+  if (control.segment () > 1)
+    std::cerr << "MB: ran " << control.segment () << " segments\n";
+  musicOutput.finish ();
+  musicInput.finish ();
+}
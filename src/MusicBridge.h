@@ -0,0 +1,83 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MUSICBRIDGE_H
+#define MUSICBRIDGE_H
+
+#include "MusicInputAdapter.h"
+#include "MusicOutputAdapter.h"
+
+/**
+ * Both directions in one MUSIC application: a MusicOutputAdapter
+ * relays spikes from SpiNNaker to MUSIC and a MusicInputAdapter
+ * spikes from MUSIC to SpiNNaker.  They share one Runtime, one
+ * connection and the clock of the MusicOutputAdapter, which follows
+ * SpiNNaker, so that a single tick serves the ports of both.
+ */
+class MusicBridge
+: public SpikesStartCallbackInterface,
+  public SpikesPauseStopCallbackInterface
+{
+public:
+  /**
+   * The adapters must have been created with createRuntime false and
+   * attached to runtime
+   */
+  MusicBridge (Runtime* runtime,
+	       MusicOutputAdapter& musicOutput,
+	       MusicInputAdapter& musicInput,
+	       double stopTime,
+	       const ThreadPlacements& placements = ThreadPlacements (),
+	       bool lockPages = false);
+
+  void main_loop ();
+
+  /**
+   * Treat a pause or stop of SpiNNaker as the end of a run segment
+   * and wait for the next start, instead of ending.  Call before
+   * main_loop ().
+   */
+  void setSegments (bool segments_) { segments = segments_; }
+
+  virtual void spikes_start (char *label,
+			     SpynnakerLiveSpikesConnection *connection);
+  virtual void spikes_stop (char *label,
+			    SpynnakerLiveSpikesConnection *connection);
+
+private:
+  void prepareRealtime ();
+  bool waitForStart ();
+  bool waitForTarget (RTClock& clock);
+  bool pause (RTClock& clock);
+
+  Runtime* runtime;
+  MusicOutputAdapter& musicOutput;	// SpiNNaker to MUSIC
+  MusicInputAdapter& musicInput;	// MUSIC to SpiNNaker
+  EventLoop loop;		// of the tick thread
+  RunControl control;
+  double stoptime;
+  bool segments;		// run segments, see setSegments ()
+
+  // CPU and scheduling of the tick thread
+  ThreadPlacements placements;
+  bool lockPages;
+};
+
+#endif /* MUSICBRIDGE_H */
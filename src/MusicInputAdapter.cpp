@@ -1,7 +1,7 @@
 /*
  *  This file is part of spinnaker-adapters
  *
- *  Copyright (C) 2017, 2018, 2019, 2021, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2019, 2021, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -24,40 +24,107 @@
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
+#include <algorithm>
 #include "MusicInputAdapter.h"
 
 /* sleep */
 #include <unistd.h>
 
+// Deadline of waits which only end on notification
+const NsTime NEVER = NsTime (INT64_MAX);
+
+// Number of events which can be in transit from the MUSIC event
+// handler to the sending thread
+const size_t RING_CAPACITY = 1 << 16;
 
 
 MusicInputAdapter::MusicInputAdapter (Setup* setup,
 				      Runtime*& runtime,
 				      double timestep,
-				      double delay,
+				      double delay_,
 				      int maxBuffered,
 				      double stoptime_,
-				      std::string label_,
-				      int nUnits,
-				      std::string portName,
+				      const PopulationSpecs& specs,
 				      bool useBarrier,
-				      double sync_)
-  : clock (timestep), syncClock (sync_), isStopping (false), stoptime (stoptime_), label (label_), sync (sync_)
+				      double sync_,
+				      std::string queueType,
+				      int maxBatch_,
+				      double holdTime_,
+				      double spinMargin,
+				      std::string latencyFile_,
+				      std::string generate,
+				      uint64_t seed,
+				      bool events,
+				      std::string overrunPolicy,
+				      double settle_,
+				      const ThreadPlacements& placements_,
+				      bool lockPages_,
+				      bool createRuntime)
+  : runtime (NULL), hosted (!createRuntime), segments (false), clock (timestep), sendClock (timestep), clockStart (0), syncClock (sync_), loop (true), control (loop), stoptime (stoptime_), sync (sync_), replay (NULL), nextStep (0), senderRunning (false), senderPlaced (false), nTicks (0), tickBlocked (0), maxTickBlocked (0), maxBatch (maxBatch_), dispatchClock (&clock), sendLatency ("send"), latencyFile (latencyFile_), syncPaused (0), syncTick ("sync tick"), syncFlush ("sync flush"), syncSettle ("sync settle"), syncContinue ("sync continue"), placements (placements_), lockPages (lockPages_), reportPlacement (!placements_.empty () || lockPages_)
 {
+  settle = NsTime::fromSeconds (settle_);
+  delay = NsTime::fromSeconds (delay_);
+  holdTime = NsTime::fromSeconds (holdTime_);
+  SpikeGenerator::Pattern pattern = SpikeGenerator::POISSON;
+  if (!generate.empty () && !SpikeGenerator::parsePattern (generate, pattern))
+    throw std::runtime_error ("unknown spike pattern: " + generate);
+  RTClock::OverrunPolicy policy;
+  if (!RTClock::parseOverrunPolicy (overrunPolicy, policy))
+    throw std::runtime_error ("unknown overrun policy: " + overrunPolicy);
+  clock.setOverrunPolicy (policy);
+  clock.setSpinMargin (spinMargin);
+  sendClock.setSpinMargin (spinMargin);
+
   if (pthread_mutex_init (&(this->music_mutex), NULL) == -1)
     throw std::runtime_error ("failed to initialize music mutex");
-  if (pthread_mutex_init (&(this->start_mutex), NULL) == -1)
-    throw std::runtime_error ("failed to initialize start mutex");
-  if (pthread_cond_init (&(this->start_condition), NULL) == -1)
-    throw std::runtime_error ("failed to initialize start condition");
   
-  in = setup->publishEventInput (portName);
-  LinearIndex indices (0, nUnits);
-  eventHandler = new MIAEventHandler (spikes, delay);
-  if (maxBuffered > 0)
-    in->map (&indices, eventHandler, 0.0, maxBuffered);
-  else
-    in->map (&indices, eventHandler);
+  // Each rank receives and sends its own slice of every population
+  MPI::Intracomm comm = setup->communicator ();
+  int rank = comm.Get_rank ();
+  int size = comm.Get_size ();
+  for (PopulationSpecs::const_iterator spec = specs.begin ();
+       spec != specs.end ();
+       ++spec)
+    {
+      MIAPopulation* pop = new MIAPopulation (*spec,
+					      RING_CAPACITY,
+					      delay_,
+					      queueType,
+					      senderLoop,
+					      senderRunning);
+      if (maxBatch > 0)
+	{
+	  pop->batch.reserve (maxBatch);
+	  pop->batchTimes.reserve (maxBatch);
+	}
+      partition (spec->nUnits, rank, size, pop->first, pop->count);
+      if (events)
+	{
+	  pop->in = setup->publishEventInput (spec->portName);
+	  LinearIndex indices (pop->first, pop->count);
+	  if (maxBuffered > 0)
+	    pop->in->map (&indices, &pop->handler, 0.0, maxBuffered);
+	  else
+	    pop->in->map (&indices, &pop->handler);
+	}
+      if (!generate.empty ())
+	{
+	  // Each rank generates the spikes of its own slice, with its
+	  // own random numbers
+	  pop->generator = new SpikeGenerator (pop->first, pop->count,
+					       pattern,
+					       seed + rank * specs.size ()
+					       + populations.size ());
+	  pop->rateIn = setup->publishContInput (spec->portName + "_rate");
+	  ArrayData array (pop->generator->rates (), MPI::DOUBLE,
+			   pop->first, pop->count);
+	  // Rates are held constant over each tick
+	  pop->rateIn->map (&array, 0.0, false);
+	}
+      populations.push_back (pop);
+    }
+  if (!createRuntime)
+    return;
   if (useBarrier)
     MPI::COMM_WORLD.Barrier();
   runtime = new Runtime (setup, timestep);
@@ -67,31 +134,64 @@ MusicInputAdapter::MusicInputAdapter (Setup* setup,
 
 MusicInputAdapter::~MusicInputAdapter ()
 {
-  delete eventHandler;
-  delete runtime;
+  for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    delete *pop;
+  if (!hosted)
+    delete runtime;
 }
 
 void
 MusicInputAdapter::spikes_start (char *label,
 				 SpynnakerLiveSpikesConnection *connection_)
 {
+  // Published to the main loop by the start request
   connection = connection_;
   
-  pthread_mutex_lock (&(this->start_mutex));
   std::cerr << "MO: Starting the simulation\n";
-  pthread_cond_signal (&(this->start_condition));
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.requestStart ();
   std::cerr << "MO: Start signal sent\n";
 }
 
 
+// Allocate, lock and place before the start, so that neither page
+// faults nor other processes get in the way later
 void
+MusicInputAdapter::prepareRealtime ()
+{
+  for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    (*pop)->spikes->reserve (RING_CAPACITY);
+  due.reserve (RING_CAPACITY);
+  generated.reserve (RING_CAPACITY);
+  // When hosted, the bridge locks memory and places the tick thread
+  if (hosted)
+    return;
+  if (lockPages)
+    lockMemory ("MO: ");
+  placeThread (placements, "tick", reportPlacement, "MO: ");
+}
+
+
+// Return false if a shutdown signal arrived first
+bool
 MusicInputAdapter::waitForStart ()
 {
-  pthread_mutex_lock (&(this->start_mutex));
   std::cerr << "MO: Waiting for start\n";
-  pthread_cond_wait (&(this->start_condition), &(this->start_mutex));
-  pthread_mutex_unlock (&(this->start_mutex));
+  return control.waitForStart ();
+}
+
+
+// Wait for the clock target.  Return false if asked to stop first.
+bool
+MusicInputAdapter::waitForTarget ()
+{
+  while (!clock.waitForTarget (loop))
+    if (control.stopRequested ())
+      return false;
+  return !control.stopRequested ();
 }
 
 
@@ -101,105 +201,549 @@ MusicInputAdapter::spikes_stop (char *label,
 				SpynnakerLiveSpikesConnection *connection)
 {
   std::cerr << "MO: Stopping the simulation\n";
-  pthread_mutex_lock (&(this->start_mutex));
-  isStopping = true;
-  pthread_cond_wait (&(this->start_condition), &(this->start_mutex));
-  isStopping = false;
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.requestStop ();
 }
 
 
 void
 MusicInputAdapter::stop ()
 {
-  pthread_mutex_lock (&(this->start_mutex));
-  pthread_cond_signal (&(this->start_condition));
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.stopped ();
   std::cerr << "MO: Stopped\n";
 }
 
+// Move events received from MUSIC into the spike queues
+void
+MusicInputAdapter::drainRings ()
+{
+  TimeIdPair spike;
+  for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    while ((*pop)->ring.pop (spike))
+      (*pop)->spikes->push (spike);
+}
+
+void
+MusicInputAdapter::setReplay (SpikeReplay* replay_)
+{
+  replay = replay_;
+  replayPopulations.clear ();
+  if (!replay->isLog ())
+    {
+      // Text files hold a single population
+      replayPopulations.push_back (populations[0]);
+      return;
+    }
+  const std::vector<LogPopulation>& logged = replay->populations ();
+  for (size_t i = 0; i < logged.size (); ++i)
+    {
+      MIAPopulation* match = NULL;
+      for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+	   pop != populations.end ();
+	   ++pop)
+	if ((*pop)->label == logged[i].label)
+	  match = *pop;
+      replayPopulations.push_back (match);
+    }
+}
+
+// Hand replayed spikes before time limit to the send path, the same
+// way MUSIC would.  Called by the tick thread.
+void
+MusicInputAdapter::replayUntil (NsTime limit)
+{
+  ReplaySpike s;
+  while (replay->peek (s) && s.time < limit)
+    {
+      replay->next (s);
+      MIAPopulation* pop = replayPopulations[s.population];
+      if (pop == NULL
+	  || (unsigned) (s.id - pop->first) >= (unsigned) pop->count)
+	continue;
+      inject (pop, s.time, s.id);
+    }
+}
+
+// Generate spikes from the rates received at the last tick, for the
+// timesteps before time limit.  Called by the tick thread.
+void
+MusicInputAdapter::generateUntil (NsTime limit)
+{
+  int64_t to = (limit - NsTime (1)).timesteps () + 1;
+  if (to <= nextStep)
+    return;
+  for (std::vector<MIAPopulation*>::iterator p = populations.begin ();
+       p != populations.end ();
+       ++p)
+    {
+      MIAPopulation* pop = *p;
+      if (pop->generator == NULL)
+	continue;
+      generated.clear ();
+      pop->generator->generate (nextStep, to, generated);
+      for (std::vector<TimeIdPair>::iterator s = generated.begin ();
+	   s != generated.end ();
+	   ++s)
+	inject (pop, s->time (), s->id ());
+    }
+  nextStep = to;
+}
+
+// Hand a spike which didn't come from MUSIC to the send path
+void
+MusicInputAdapter::inject (MIAPopulation* pop, NsTime t, int id)
+{
+  pop->handler.insert (t, id);
+}
+
+// Feed replayed and generated spikes before time limit into the send
+// path
+void
+MusicInputAdapter::feedUntil (NsTime limit)
+{
+  if (replay)
+    replayUntil (limit);
+  generateUntil (limit);
+}
+
+// Send all spikes due at time t since start.  Return false if there
+// were none.
+bool
+MusicInputAdapter::sendDueSpikes (NsTime t)
+{
+  bool sent = false;
+  for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    if (sendDueSpikes (*pop, t))
+      sent = true;
+  return sent;
+}
+
+bool
+MusicInputAdapter::sendDueSpikes (MIAPopulation* pop, NsTime t)
+{
+  pop->spikes->popUntil (t, due);
+  if (maxBatch > 0)
+    return sendBatched (pop, t);
+  if (due.empty ())
+    return false;
+  for (std::vector<TimeIdPair>::iterator s = due.begin ();
+       s != due.end ();
+       ++s)
+    {
+      connection->send_spike ((char *) pop->label.c_str (), s->id ());
+      recordLatency (s->time (), RTClock::getTime ());
+    }
+  pop->nSent += due.size ();
+  due.clear ();
+  return true;
+}
+
+// Collect due spikes into batches which are sent with one
+// send_spikes call each.  A partial batch is held back until its
+// oldest spike is holdTime late.
+bool
+MusicInputAdapter::sendBatched (MIAPopulation* pop, NsTime t)
+{
+  bool sent = false;
+  for (std::vector<TimeIdPair>::iterator s = due.begin ();
+       s != due.end ();
+       ++s)
+    {
+      if (pop->batch.empty ())
+	pop->batchStart = s->time ();
+      pop->batch.push_back (s->id ());
+      pop->batchTimes.push_back (s->time ());
+      if ((int) pop->batch.size () >= maxBatch)
+	{
+	  flushBatch (pop);
+	  sent = true;
+	}
+    }
+  due.clear ();
+  if (!pop->batch.empty ())
+    {
+      if (pop->batchStart + holdTime <= t)
+	{
+	  flushBatch (pop);
+	  sent = true;
+	}
+    }
+  return sent;
+}
+
+// Wait until the next spike or held batch may be due, but at most
+// until the absolute time limit.
+void
+MusicInputAdapter::waitForSpikes (RTClock& c, EventLoop& l, NsTime limit)
+{
+  NsTime deadline = limit;
+  NsTime next;
+  for (std::vector<MIAPopulation*>::iterator p = populations.begin ();
+       p != populations.end ();
+       ++p)
+    {
+      MIAPopulation* pop = *p;
+      if (pop->spikes->nextDue (&next))
+	deadline = std::min (deadline, c.absoluteTime (next));
+      if (!pop->batch.empty ())
+	deadline = std::min (deadline,
+			     c.absoluteTime (pop->batchStart + holdTime));
+    }
+  c.waitUntil (deadline, l);
+}
+
+void
+MusicInputAdapter::flushBatch (MIAPopulation* pop)
+{
+  if (pop->batch.empty ())
+    return;
+  connection->send_spikes ((char *) pop->label.c_str (), pop->batch);
+  NsTime now = RTClock::getTime ();
+  for (std::vector<NsTime>::iterator t = pop->batchTimes.begin ();
+       t != pop->batchTimes.end ();
+       ++t)
+    recordLatency (*t, now);
+  pop->nSent += pop->batch.size ();
+  pop->batch.clear ();
+  pop->batchTimes.clear ();
+}
+
+// Record latency of a spike scheduled at time since start which was
+// sent at absolute time now
+void
+MusicInputAdapter::recordLatency (NsTime scheduled, NsTime now)
+{
+  sendLatency.record ((dispatchClock->relativeTime (now) - scheduled).ns ());
+}
+
+void
+MusicInputAdapter::dumpLatency ()
+{
+  if (latencyFile.empty ())
+    return;
+  std::vector<const LatencyHistogram*> histograms;
+  histograms.push_back (&sendLatency);
+  if (sync > 0.0)
+    {
+      histograms.push_back (&syncTick);
+      histograms.push_back (&syncFlush);
+      histograms.push_back (&syncSettle);
+      histograms.push_back (&syncContinue);
+    }
+  LatencyHistogram::dump (latencyFile, histograms);
+}
+
+// Send all held batches.  Return false if there were none.
+bool
+MusicInputAdapter::flushBatches ()
+{
+  bool sent = false;
+  for (std::vector<MIAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    if (!(*pop)->batch.empty ())
+      {
+	flushBatch (*pop);
+	sent = true;
+      }
+  return sent;
+}
+
 // Use templates instead
 
 void MusicInputAdapter::main_loop() {
+  prepareRealtime ();
   if (sync <= 0.0)
     main_loop_nosync ();
   else
     main_loop_sync ();
+  flushBatches ();
+  report ();
   runtime->finalize ();
 }
 
+NsTime
+MusicInputAdapter::timedTick ()
+{
+  NsTime before = RTClock::getTime ();
+  runtime->tick ();
+  NsTime blocked = RTClock::getTime () - before;
+  countTick (blocked);
+  return blocked;
+}
+
+void
+MusicInputAdapter::countTick (NsTime blocked)
+{
+  ++nTicks;
+  tickBlocked += blocked.ns ();
+  if (blocked.ns () > maxTickBlocked)
+    maxTickBlocked = blocked.ns ();
+  // When hosted, the bridge dumps the histograms of both adapters
+  if (!hosted && LatencyHistogram::dumpRequested ())
+    dumpLatency ();
+}
+
+// Publish time 0 of master to the sender.  Called by the tick thread
+// whenever master may have moved.
+void
+MusicInputAdapter::followClock (const RTClock& master)
+{
+  clockStart.store (master.absoluteTime (NsTime ()).ns (),
+		    std::memory_order_release);
+}
+
+void
+MusicInputAdapter::report ()
+{
+  if (nTicks == 0)
+    return;
+  if (control.segment () > 1)
+    std::cerr << "MO: ran " << control.segment () << " segments\n";
+  std::cerr << "MO: " << nTicks << " ticks, blocked in tick () "
+	    << 1e-6 * tickBlocked / nTicks << " ms on average, "
+	    << 1e-6 * maxTickBlocked << " ms at most\n";
+  // When hosted, the clock and the process belong to the bridge
+  if (!hosted)
+    std::cerr << "MO: tick thread woke " << 1e6 * clock.meanLateness ()
+	      << " us late on average, " << 1e6 * clock.maxLateness ()
+	      << " us at most (" << clock.nWaits () << " waits)\n";
+  if (sendClock.nWaits () > 0)
+    std::cerr << "MO: sender woke " << 1e6 * sendClock.meanLateness ()
+	      << " us late on average, " << 1e6 * sendClock.maxLateness ()
+	      << " us at most (" << sendClock.nWaits () << " waits)\n";
+  if (!hosted)
+    {
+      clock.overrunSummary (std::cerr, "MO: ");
+      std::cerr << "MO: used " << RTClock::cpuTime () << " s CPU time\n";
+      RTClock::sourceSummary (std::cerr, "MO: ");
+    }
+  sendLatency.summary (std::cerr, "MO: ");
+  if (sync > 0.0)
+    {
+      syncTick.summary (std::cerr, "MO: ", "intervals");
+      syncFlush.summary (std::cerr, "MO: ", "intervals");
+      syncSettle.summary (std::cerr, "MO: ", "intervals");
+      syncContinue.summary (std::cerr, "MO: ", "intervals");
+      std::cerr << "MO: SpiNNaker paused " << 1e-3 * syncPaused / nTicks
+		<< " us per interval, "
+		<< 100.0 * syncPaused / (syncPaused + 1e9 * sync * nTicks)
+		<< "% of the time\n";
+    }
+  dumpLatency ();
+  for (std::vector<MIAPopulation*>::iterator p = populations.begin ();
+       p != populations.end ();
+       ++p)
+    {
+      MIAPopulation* pop = *p;
+      std::cerr << "MO: " << pop->label << ": sent " << pop->nSent
+		<< " spikes\n";
+      if (pop->generator)
+	std::cerr << "MO: " << pop->label << ": generated "
+		  << pop->generator->nGenerated () << " spikes from rates\n";
+      if (pop->handler.stalls () > 0)
+	std::cerr << "MO: " << pop->label << ": event handler waited "
+		  << pop->handler.stalls () << " times for the sender\n";
+    }
+}
+
+void*
+MusicInputAdapter::senderThread (void* arg)
+{
+  static_cast<MusicInputAdapter*> (arg)->sender_loop ();
+  return NULL;
+}
+
+void
+MusicInputAdapter::startSender ()
+{
+  senderRunning = true;
+  if (pthread_create (&sender, NULL, senderThread, this) != 0)
+    throw std::runtime_error ("failed to create sender thread");
+}
+
+void
+MusicInputAdapter::stopSender ()
+{
+  if (!senderRunning)
+    return;
+  senderRunning = false;
+  senderLoop.notify ();
+  pthread_join (sender, NULL);
+}
+
+// Sending thread: dispatch spikes independently of the MUSIC tick
+void
+MusicInputAdapter::sender_loop ()
+{
+  // A new sender is started for each run segment
+  placeThread (placements, "send", reportPlacement && !senderPlaced, "MO: ");
+  senderPlaced = true;
+  while (senderRunning)
+    {
+      // Follow the tick clock when it has moved
+      NsTime start (clockStart.load (std::memory_order_acquire));
+      if (start != sendStart)
+	{
+	  sendClock.slew (sendStart - start);
+	  sendStart = start;
+	}
+      drainRings ();
+      NsTime now = RTClock::getTime ();
+      if (!sendDueSpikes (sendClock.relativeTime (now)))
+	// The tick thread wakes us when new events arrive through
+	// the rings
+	waitForSpikes (sendClock, senderLoop, NEVER);
+    }
+  flushBatches ();
+}
+
+void
+MusicInputAdapter::startSending (const RTClock& master)
+{
+  sendClock.sync (master);
+  sendStart = master.absoluteTime (NsTime ());
+  clockStart = sendStart.ns ();
+  dispatchClock = &sendClock;
+  startSender ();
+}
+
+void
+MusicInputAdapter::beforeTick (const RTClock& master)
+{
+  feedUntil (NsTime::fromSeconds (runtime->time ()) + master.intervalNs ());
+}
+
+void
+MusicInputAdapter::afterTick (const RTClock& master, NsTime blocked)
+{
+  countTick (blocked);
+  followClock (master);
+  senderLoop.notify ();
+}
+
+void
+MusicInputAdapter::stopSending ()
+{
+  stopSender ();
+  flushBatches ();
+}
+
+void
+MusicInputAdapter::finish ()
+{
+  stopSending ();
+  report ();
+}
+
+// SpiNNaker has paused or stopped, or a shutdown signal arrived.
+// With run segments, hold the clock, queues and MUSIC until the next
+// start.  Return false if the main loop should end.
+bool
+MusicInputAdapter::pause ()
+{
+  stopSending ();
+  clock.stop ();
+  stop ();
+  if (!segments || !waitForStart ())
+    return false;
+  clock.start ();
+  if (sync <= 0.0)
+    startSending (clock);
+  return true;
+}
+
 void MusicInputAdapter::main_loop_nosync() {
   clock.resetAndStop ();
-  waitForStart ();
+  if (!waitForStart ())
+    {
+      control.finished ();
+      return;
+    }
   clock.start ();
+  startSending (clock);
   while (clock.time () < stoptime)
     {
+      beforeTick (clock);
       clock.setNextTarget ();
-      // Send all spikes until next target.
-
-      struct timespec t;
-      clock.getTime (&t);
-      while (!clock.pastTarget (t))
-	{
-	  if (isStopping)
-	    goto stop;
-	  if (!spikes.empty () && clock.lessThanEql (spikes.top ().time (), &t))
-	    {
-	      connection->send_spike ((char *) label.c_str (), spikes.top ().id ());
-	      //std::cerr << RTClock::secondsFromTimespec(*spikes.top().time()) << '\t' << clock.time() << '\n';
-	      spikes.pop ();
-	    }
-	  else
-	    sched_yield ();
-	  clock.getTime (&t);
-	}
-      runtime->tick ();
-      continue;
-      
-    stop:
-      clock.stop ();
-      stop ();
-      break;
+      followClock (clock);
+      senderLoop.notify ();
+      // Spikes are sent by the sender thread.  Tick at next target,
+      // which the next segment picks up after a pause.
+      while (!waitForTarget ())
+	if (!pause ())
+	  goto stop;
+      timedTick ();
+      senderLoop.notify ();
     }
-
+ stop:
+  stopSender ();
+  // A stop request after the end needn't wait
+  control.finished ();
 }
 
 void MusicInputAdapter::main_loop_sync() {
   clock.resetAndStop ();
-  waitForStart ();
+  if (!waitForStart ())
+    {
+      control.finished ();
+      return;
+    }
   clock.start ();
   while (clock.time () < stoptime)
     {
+      feedUntil (NsTime::fromSeconds (runtime->time ()) + clock.intervalNs ());
       clock.setNextTarget ();
-      // Send all spikes until next target.
+      // Tick while SpiNNaker runs this interval, then send all spikes
+      // until next target.
+      syncTick.record (timedTick ().ns ());
 
-      struct timespec t;
-      clock.getTime (&t);
-      while (!clock.pastTarget (t))
+      NsTime now = RTClock::getTime ();
+      while (!clock.pastTarget (now))
 	{
-	  if (isStopping)
-	    goto stop;
-	  if (!spikes.empty () && clock.lessThanEql (spikes.top ().time (), &t))
+	  if (control.stopRequested ())
 	    {
-	      connection->send_spike ((char *) label.c_str (), spikes.top ().id ());
-	      //std::cerr << RTClock::secondsFromTimespec(*spikes.top().time()) << '\t' << clock.time() << '\n';
-	      spikes.pop ();
+	      if (!pause ())
+		goto stop;
+	      now = RTClock::getTime ();
+	      continue;
 	    }
+	  drainRings ();
+	  if (sendDueSpikes (clock.relativeTime (now)))
+	    lastSent = now;
 	  else
-	    sched_yield ();
-	  clock.getTime (&t);
+	    waitForSpikes (clock, loop, clock.target ());
+	  now = RTClock::getTime ();
 	}
-      clock.stop ();
-      runtime->tick ();
-      usleep (1000);
-      connection->continue_run ();
-      clock.start ();
-      continue;
-      
-    stop:
-      clock.stop ();
-      stop ();
-      break;
+      {
+	// The board has paused.  Hand over the rest of this interval's
+	// spikes, then let it continue at once, unless spikes were
+	// sent less than settle ago.
+	NsTime paused = now;
+	drainRings ();
+	bool sent = sendDueSpikes (clock.relativeTime (clock.target ())
+				   - NsTime (1));
+	if (flushBatches ())
+	  sent = true;
+	if (sent)
+	  lastSent = RTClock::getTime ();
+	clock.stop ();
+	NsTime flushed = RTClock::getTime ();
+	if (lastSent + settle > flushed)
+	  clock.waitUntil (lastSent + settle);
+	NsTime settled = RTClock::getTime ();
+	connection->continue_run ();
+	NsTime resumed = RTClock::getTime ();
+	clock.start ();
+	syncFlush.record ((flushed - paused).ns ());
+	syncSettle.record ((settled - flushed).ns ());
+	syncContinue.record ((resumed - settled).ns ());
+	syncPaused += (resumed - paused).ns ();
+      }
     }
-
+ stop:
+  control.finished ();
 }
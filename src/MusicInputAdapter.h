@@ -1,7 +1,7 @@
 /*
  *  This file is part of spinnaker-adapters
  *
- *  Copyright (C) 2017, 2018, 2021, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2021, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -18,57 +18,117 @@
  *
  */
 
-#ifndef MUSICOUTPUTADAPTER_H
-#define MUSICOUTPUTADAPTER_H
+#ifndef MUSICINPUTADAPTER_H
+#define MUSICINPUTADAPTER_H
 
 #include "rtclock.h"
+#include "EventLoop.h"
+#include "LatencyHistogram.h"
+#include "Population.h"
+#include "SpikeGenerator.h"
+#include "SpikeLog.h"
+#include "SpikeQueue.h"
+#include "SpscRing.h"
+#include "ThreadPlacement.h"
 #include <SpynnakerLiveSpikesConnection.h>
 #include <map>
-#include <queue>
+#include <vector>
 #include <set>
 #include <pthread.h>
+#include <sched.h>
+#include <atomic>
 #include <music.hh>
 
 using namespace MUSIC;
 
-// Inner class used in priority queue
-class TimeIdPair
-{
- public:
-
-  //TimeIdPair () { time_ = -1; };
-  TimeIdPair (double time, MUSIC::GlobalIndex id) {
-    time_ = RTClock::timespecFromSeconds (time);
-    id_ = id;
+// Called by MUSIC in the tick thread.  Events are handed over to the
+// sending thread through a lock-free ring, or go straight into the
+// spike queue when no sending thread runs.
+class MIAEventHandler: public MUSIC::EventHandlerGlobalIndex {
+public:
+  MIAEventHandler (SpscRing<TimeIdPair>& ring_,
+		   SpikeQueue* spikes_,
+		   double delay_,
+		   EventLoop& sender_,
+		   const std::atomic<bool>& senderRunning_)
+    : ring (ring_), spikes (spikes_), delay (NsTime::fromSeconds (delay_)),
+      sender (sender_), senderRunning (senderRunning_), nStalls (0) { }
+  
+  void operator () (double t, MUSIC::GlobalIndex id)
+  {
+    insert (NsTime::fromSeconds (t), id);
   }
 
-  bool operator< (const TimeIdPair& right) const {
-    // Note that we use > here, since we want lowest items first
-    return timespeccmp (&time_, right.time (), >);
+  // Also used for spikes which don't come from MUSIC
+  void insert (NsTime t, MUSIC::GlobalIndex id)
+  {
+    TimeIdPair spike (t + delay, id);
+    if (!senderRunning.load (std::memory_order_relaxed))
+      {
+	// This thread is the one which would empty the ring
+	spikes->push (spike);
+	return;
+      }
+    if (ring.push (spike))
+      return;
+    // The sender is behind, or asleep until the end of the tick.
+    // Wake it and wait for it to make room.
+    ++nStalls;
+    sender.notify ();
+    while (!ring.push (spike))
+      sched_yield ();
   }
 
-  const struct timespec* time () const { return &time_; }
-  MUSIC::GlobalIndex id () const { return id_; }
+  unsigned long stalls () const { return nStalls; }
 
  private:
-  struct timespec time_;
-  MUSIC::GlobalIndex id_;
+  SpscRing<TimeIdPair>& ring;
+  SpikeQueue* spikes;
+  NsTime delay;
+  EventLoop& sender;		// of the sending thread
+  const std::atomic<bool>& senderRunning; // set by the tick thread
+  unsigned long nStalls;
 };
 
 
-class MIAEventHandler: public MUSIC::EventHandlerGlobalIndex {
-public:
-  MIAEventHandler (std::priority_queue<TimeIdPair>& spikes_, double delay_)
-    : spikes (spikes_), delay (delay_) { }
-  
-  void operator () (double t, MUSIC::GlobalIndex id)
-  {
-    spikes.push (TimeIdPair (t + delay, id));
-  }
+// A population relayed from MUSIC to SpiNNaker
+struct MIAPopulation
+{
+  MIAPopulation (const PopulationSpec& spec,
+		 size_t capacity,
+		 double delay,
+		 const std::string& queueType,
+		 EventLoop& sender,
+		 const std::atomic<bool>& senderRunning)
+    : label (spec.label), in (0), rateIn (0), generator (0),
+      first (0), count (0),
+      ring (capacity),
+      spikes (SpikeQueue::create (queueType, NsTime::fromTimesteps (1))),
+      handler (ring, spikes, delay, sender, senderRunning),
+      nSent (0) { }
+  ~MIAPopulation () { delete spikes; delete generator; }
 
- private:
-  std::priority_queue<TimeIdPair>& spikes;
-  double delay;
+  std::string label;
+  EventInputPort* in;		// NULL if only rates are received
+
+  // Spikes generated from rates, NULL unless rates are received
+  ContInputPort* rateIn;
+  SpikeGenerator* generator;
+
+  // Slice of the population owned by this rank
+  int first;
+  int count;
+
+  SpscRing<TimeIdPair> ring;
+  SpikeQueue* spikes;
+  MIAEventHandler handler;
+
+  // Batched sending
+  NsTime batchStart; // time of oldest spike in batch
+  std::vector<int> batch;
+  std::vector<NsTime> batchTimes;
+
+  unsigned long nSent;
 };
 
 
@@ -84,14 +144,39 @@ public:
 		       double delay,
 		       int maxBuffered,
 		       double stopTime,
-		       std::string label,
-		       int nUnits,
-		       std::string portName,
+		       const PopulationSpecs& populations,
 		       bool useBarrier = false,
-		       double sync = 0.0);
+		       double sync = 0.0,
+		       std::string queueType = "wheel",
+		       int maxBatch = 0,
+		       double holdTime = 0.0,
+		       double spinMargin = -1.0,
+		       std::string latencyFile = "",
+		       std::string generate = "",
+		       uint64_t seed = 0,
+		       bool events = true,
+		       std::string overrunPolicy = "burst",
+		       double settle = 0.0,
+		       const ThreadPlacements& placements = ThreadPlacements (),
+		       bool lockPages = false,
+		       bool createRuntime = true);
     virtual ~MusicInputAdapter();
     
     void main_loop();
+
+    /**
+     * Also send the spikes of a spike log or TIME ID text file, as if
+     * they came through the MUSIC ports.  Call before main_loop ().
+     */
+    void setReplay (SpikeReplay* replay);
+
+    /**
+     * Treat a pause or stop of SpiNNaker as the end of a run segment
+     * and wait for the next start, instead of ending.  Call before
+     * main_loop ().
+     */
+    void setSegments (bool segments_) { segments = segments_; }
+
     void main_loop_nosync();
     void main_loop_sync();
     virtual void spikes_start (char *label,
@@ -99,28 +184,146 @@ public:
     virtual void spikes_stop (char *label,
 			      SpynnakerLiveSpikesConnection *connection);
 
+    /**
+     * Hosting by spinnmusic-bridge, which creates the Runtime (pass
+     * createRuntime false to the constructor), owns the clock and the
+     * connection, and ticks MUSIC for both directions.  The sync
+     * protocol is not available there.
+     */
+    void attach (Runtime* runtime_) { runtime = runtime_; }
+    void setConnection (SpynnakerLiveSpikesConnection* connection_)
+    {
+      connection = connection_;
+    }
+    void prepareRealtime ();
+
+    /**
+     * Start the sending thread on the time of master, which has just
+     * been started
+     */
+    void startSending (const RTClock& master);
+
+    /**
+     * Before a tick of the hosting loop: feed replayed and generated
+     * spikes of the coming tick
+     */
+    void beforeTick (const RTClock& master);
+
+    /**
+     * After a tick which blocked for blocked: let the sender follow
+     * master and pick up the spikes MUSIC delivered
+     */
+    void afterTick (const RTClock& master, NsTime blocked);
+
+    /**
+     * Write the latency histograms to the latency file, if any
+     */
+    void dumpLatency ();
+
+    /**
+     * Stop the sending thread and send the held batches
+     */
+    void stopSending ();
+
+    /**
+     * Stop sending, if still running, and report
+     */
+    void finish ();
+
 private:
 
-    void waitForStart ();
+    bool waitForStart ();
+    bool waitForTarget ();
+    bool pause ();
     void stop ();
+    bool sendDueSpikes (NsTime t);
+    bool sendDueSpikes (MIAPopulation* pop, NsTime t);
+    void waitForSpikes (RTClock& c, EventLoop& l, NsTime limit);
+    bool sendBatched (MIAPopulation* pop, NsTime t);
+    void flushBatch (MIAPopulation* pop);
+    bool flushBatches ();
+    void drainRings ();
+    void replayUntil (NsTime limit);
+    void generateUntil (NsTime limit);
+    void inject (MIAPopulation* pop, NsTime t, int id);
+    void feedUntil (NsTime limit);
+    NsTime timedTick ();
+    void countTick (NsTime blocked);
+    void followClock (const RTClock& master);
+    void startSender ();
+    void stopSender ();
+    static void* senderThread (void* arg);
+    void sender_loop ();
+    void report ();
+    void recordLatency (NsTime scheduled, NsTime now);
     
     Runtime* runtime;
+    bool hosted;			// by spinnmusic-bridge
+    bool segments;		// run segments, see setSegments ()
     EventInputPort* in;
     RTClock clock;
+    RTClock sendClock;		// used by the sender thread
+    // Absolute time 0 of the tick clock, followed by sendClock when
+    // overruns hold the tick clock back or synchronization moves it
+    std::atomic<int64_t> clockStart; // ns
+    NsTime sendStart;
     RTClock syncClock;
-    bool isStopping;
+    EventLoop loop;		// of the tick thread
+    RunControl control;
     double stoptime;
-    std::string label;
+    std::vector<MIAPopulation*> populations;
 
     double sync;
+    NsTime delay;
+
+    // Replay, NULL unless replaying.  replayPopulations maps
+    // populations of the replayed file to ours (NULL if not relayed).
+    SpikeReplay* replay;
+    std::vector<MIAPopulation*> replayPopulations;
+
+    // Spike generation from rates: timesteps before nextStep are done
+    int64_t nextStep;
+    std::vector<TimeIdPair> generated;
     
     pthread_mutex_t music_mutex;
-    pthread_mutex_t start_mutex;
-    pthread_cond_t start_condition;
 
     SpynnakerLiveSpikesConnection* connection;
-    std::priority_queue<TimeIdPair> spikes;
-    MIAEventHandler* eventHandler;
+    std::vector<TimeIdPair> due;
+
+    // Sending thread
+    pthread_t sender;
+    std::atomic<bool> senderRunning;
+    bool senderPlaced;		// used by the sender thread
+    EventLoop senderLoop;	// woken when spikes enter the rings
+
+    // Time spent blocked in runtime->tick ()
+    unsigned long nTicks;
+    int64_t tickBlocked;	// ns
+    int64_t maxTickBlocked;	// ns
+
+    // Batched sending
+    int maxBatch;
+    NsTime holdTime;
+
+    // Scheduled time versus time send_spike returned
+    RTClock* dispatchClock;	// clock of the sending thread
+    LatencyHistogram sendLatency;
+    std::string latencyFile;
+
+    // Sync protocol: continue_run () waits until settle after the
+    // last spike sent.  The phases of each interval are timed.
+    NsTime settle;
+    NsTime lastSent;
+    int64_t syncPaused;		// ns, board waiting for continue_run ()
+    LatencyHistogram syncTick;
+    LatencyHistogram syncFlush;
+    LatencyHistogram syncSettle;
+    LatencyHistogram syncContinue;
+
+    // CPUs and scheduling of the tick and send threads
+    ThreadPlacements placements;
+    bool lockPages;
+    bool reportPlacement;
 };
 
 #endif /* MUSICINPUTADAPTER_H */
@@ -1,7 +1,7 @@
 /*
  *  This file is part of spinnaker-adapters
  *
- *  Copyright (C) 2017, 2018, 2019, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2019, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -24,32 +24,125 @@
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
+#include <algorithm>
 #include "MusicOutputAdapter.h"
 
 /* sleep */
 #include <unistd.h>
 
+// Number of spikes which can be staged between two ticks
+const size_t STAGING_CAPACITY = 1 << 16;
+
+// Timesteps whose spikes are inserted in one tick, reserved up front
+const size_t INSERTED_CAPACITY = 1024;
+
+// Number of clock samples which can be queued between two ticks
+const size_t SYNC_CAPACITY = 1 << 10;
+
+// The clock is slewed by at most this fraction of the tick interval
+// per tick
+const double MAX_SLEW = 0.05;
+
+// Larger deviations from the SpiNNaker clock (in seconds) are
+// corrected at once
+const double SNAP_LIMIT = 0.1;
+
 MusicOutputAdapter::MusicOutputAdapter (Setup* setup,
 					Runtime*& runtime,
 					double timestep,
 					double delay_,
 					double stoptime_,
-					std::string label,
-					int nUnits,
-					std::string portName,
-					bool useBarrier)
-  : clock (timestep), delay (delay_), isStopping (false), stoptime (stoptime_)
+					const PopulationSpecs& specs,
+					bool useBarrier,
+					double spinMargin,
+					int syncWindow_,
+					std::string syncStatsFile,
+					int reorderWindow,
+					std::string latePolicy_,
+					std::string latencyFile_,
+					std::string recordFile,
+					double rateWindow,
+					int groupSize,
+					bool events,
+					std::string overrunPolicy,
+					const ThreadPlacements& placements_,
+					bool lockPages_,
+					bool createRuntime)
+  : runtime (NULL), hosted (!createRuntime), segments (false), clock (timestep), clockStart (0), delay (delay_), loop (true), control (loop), stoptime (stoptime_), syncSamples (SYNC_CAPACITY), lastSampleTime (-1), syncWindow (syncWindow_), clockSync (syncWindow_), syncStats (NULL), maxOffset (0.0), receiveLatency ("receive"), tickLatency ("tick"), latencyFile (latencyFile_), recorder (NULL), replay (NULL), fastReplay (false), replayRunning (false), placements (placements_), lockPages (lockPages_), reportPlacement (!placements_.empty () || lockPages_), receivePlaced (false)
 {
+  if (latePolicy_ == "count")
+    latePolicy = LATE_COUNT;
+  else if (latePolicy_ == "drop")
+    latePolicy = LATE_DROP;
+  else if (latePolicy_ == "clamp")
+    latePolicy = LATE_CLAMP;
+  else
+    throw std::runtime_error ("unknown late spike policy: " + latePolicy_);
+  RTClock::OverrunPolicy policy;
+  if (!RTClock::parseOverrunPolicy (overrunPolicy, policy))
+    throw std::runtime_error ("unknown overrun policy: " + overrunPolicy);
+  clock.setOverrunPolicy (policy);
+  // The clock follows SpiNNaker
+  clock.setSynchronized (true);
+
+  clock.setSpinMargin (spinMargin);
+  if (!syncStatsFile.empty ())
+    {
+      syncStats = new std::ofstream (syncStatsFile.c_str ());
+      if (!*syncStats)
+	throw std::runtime_error ("couldn't open " + syncStatsFile);
+      *syncStats << "host,spinnaker,offset,drift_ppm,residual,correction\n";
+    }
+
   if (pthread_mutex_init (&(this->music_mutex), NULL) == -1)
     throw std::runtime_error ("failed to initialize music mutex");
-  if (pthread_mutex_init (&(this->start_mutex), NULL) == -1)
-    throw std::runtime_error ("failed to initialize start mutex");
-  if (pthread_cond_init (&(this->start_condition), NULL) == -1)
-    throw std::runtime_error ("failed to initialize start condition");
   
-  out = setup->publishEventOutput (portName);
-  LinearIndex indices (0, nUnits);
-  out->map (&indices, MUSIC::Index::GLOBAL);
+  // Each rank relays its own slice of every population
+  MPI::Intracomm comm = setup->communicator ();
+  int rank = comm.Get_rank ();
+  int size = comm.Get_size ();
+  if (!recordFile.empty ())
+    {
+      // Each rank records its own slice
+      if (size > 1)
+	recordFile += "." + std::to_string (rank);
+      recorder = new SpikeRecorder (recordFile, specs);
+    }
+  for (PopulationSpecs::const_iterator spec = specs.begin ();
+       spec != specs.end ();
+       ++spec)
+    {
+      MOAPopulation* pop = new MOAPopulation (*spec,
+					      STAGING_CAPACITY,
+					      reorderWindow);
+      partition (spec->nUnits, rank, size, pop->first, pop->count);
+      if (recorder)
+	pop->recordBase = recorder->key (populations.size (), 0);
+      if (events)
+	{
+	  pop->out = setup->publishEventOutput (spec->portName);
+	  LinearIndex indices (pop->first, pop->count);
+	  pop->out->map (&indices, MUSIC::Index::GLOBAL);
+	}
+      if (rateWindow > 0.0)
+	{
+	  // Rates are relayed in groups, which are divided between
+	  // ranks on their own
+	  int nGroups = (spec->nUnits + groupSize - 1) / groupSize;
+	  int first, count;
+	  partition (nGroups, rank, size, first, count);
+	  int window = std::max (1, (int) (rateWindow / timestep + 0.5));
+	  pop->rates = new RateEstimator (spec->nUnits, groupSize,
+					  first, count, window, timestep);
+	  pop->rateOut = setup->publishContOutput (spec->portName + "_rate");
+	  ArrayData array (pop->rates->rates (), MPI::DOUBLE, first, count);
+	  pop->rateOut->map (&array);
+	}
+      populations.push_back (pop);
+      byLabel[spec->label] = pop;
+    }
+  if (!createRuntime)
+    return;
   if (useBarrier)
     MPI::COMM_WORLD.Barrier();
   runtime = new Runtime (setup, timestep);
@@ -61,21 +154,45 @@ void
 MusicOutputAdapter::spikes_start (char *label,
 				  SpynnakerLiveSpikesConnection *connection)
 {
-  pthread_mutex_lock (&(this->start_mutex));
   std::cerr << "MI: Starting the simulation\n";
-  pthread_cond_signal (&(this->start_condition));
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.requestStart ();
   std::cerr << "MI: Start signal sent\n";
 }
 
 
+// Allocate, lock and place before the start, so that neither page
+// faults nor other processes get in the way later
 void
+MusicOutputAdapter::prepareRealtime ()
+{
+  released.reserve (STAGING_CAPACITY);
+  inserted.reserve (INSERTED_CAPACITY);
+  // When hosted, the bridge locks memory and places the tick thread
+  if (hosted)
+    return;
+  if (lockPages)
+    lockMemory ("MI: ");
+  placeThread (placements, "tick", reportPlacement, "MI: ");
+}
+
+
+// Return false if a shutdown signal arrived first
+bool
 MusicOutputAdapter::waitForStart ()
 {
-  pthread_mutex_lock (&(this->start_mutex));
   std::cerr << "MI: Waiting for start\n";
-  pthread_cond_wait (&(this->start_condition), &(this->start_mutex));
-  pthread_mutex_unlock (&(this->start_mutex));
+  return control.waitForStart ();
+}
+
+
+// Wait for the clock target.  Return false if asked to stop first.
+bool
+MusicOutputAdapter::waitForTarget ()
+{
+  while (!clock.waitForTarget (loop))
+    if (control.stopRequested ())
+      return false;
+  return !control.stopRequested ();
 }
 
 
@@ -84,20 +201,14 @@ MusicOutputAdapter::spikes_stop (char *label,
 				 SpynnakerLiveSpikesConnection *connection)
 {
   std::cerr << "MI: Stopping the simulation\n";
-  pthread_mutex_lock (&(this->start_mutex));
-  isStopping = true;
-  pthread_cond_wait (&(this->start_condition), &(this->start_mutex));
-  isStopping = false;
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.requestStop ();
 }
 
 
 void
 MusicOutputAdapter::stop ()
 {
-  pthread_mutex_lock (&(this->start_mutex));
-  pthread_cond_signal (&(this->start_condition));
-  pthread_mutex_unlock (&(this->start_mutex));
+  control.stopped ();
   std::cerr << "MI: Stopped\n";
 }
 
@@ -108,44 +219,474 @@ MusicOutputAdapter::receive_spikes (char *label,
 				    int n_spikes,
 				    int *spikes)
 {
-  double t = 1e-3 * time;
-  clock.set (t); // synchronize with SpiNNaker
-  pthread_mutex_lock (&(this->music_mutex));
+  if (!receivePlaced)
+    {
+      placeThread (placements, "receive", reportPlacement, "MI: ");
+      receivePlaced = true;
+    }
+  NsTime now = RTClock::getTime ();
+  if (time != lastSampleTime)
+    {
+      // Note arrival time for synchronization with SpiNNaker
+      SyncSample sample = { time, now };
+      syncSamples.push (sample);
+      lastSampleTime = time;
+    }
+  // The tick thread owns clock; it publishes time 0 in clockStart
+  NsTime start (clockStart.load (std::memory_order_acquire));
+  receiveLatency.record ((now - start
+			  - NsTime::fromTimesteps (time)).ns (),
+			 n_spikes);
+  std::map<std::string, MOAPopulation*>::iterator p = byLabel.find (label);
+  if (p == byLabel.end ())
+    return;
+  MOAPopulation* pop = p->second;
+  // Never wait for the tick thread here; drop spikes if it is behind
   for (int i = 0; i < n_spikes; i++)
     {
-      int id = spikes[i];
-      out->insertEvent (t + delay, MUSIC::GlobalIndex (id));
+      if (pop->rates)
+	pop->rates->count (spikes[i]);
+      // Skip spikes from neurons owned by other ranks
+      if ((unsigned) (spikes[i] - pop->first) >= (unsigned) pop->count)
+	continue;
+      if (recorder)
+	recorder->record (now, time, pop->recordBase + spikes[i]);
+      if (pop->out == NULL)
+	continue;
+      StagedSpike spike = { time, spikes[i] };
+      if (!pop->staging.push (spike))
+	++pop->nDropped;
+    }
+}
+
+
+// Return the last SpiNNaker timestep which must leave through the
+// coming tick
+int
+MusicOutputAdapter::tickLimit ()
+{
+  // Spikes which would be late at the coming tick can't be held
+  double now = runtime->time ();
+  NsTime horizon = NsTime::fromSeconds (now + clock.interval () - delay);
+  return (horizon - NsTime (1)).timesteps ();
+}
+
+
+// Hand staged spikes over to MUSIC in time order.  Called by the
+// tick thread.
+void
+MusicOutputAdapter::insertStaged (MOAPopulation* pop)
+{
+  StagedSpike spike;
+  while (pop->staging.pop (spike))
+    pop->reorder.add (spike);
+
+  double now = runtime->time ();
+  pop->reorder.release (tickLimit (), released);
+
+  for (std::vector<StagedSpike>::iterator s = released.begin ();
+       s != released.end ();
+       ++s)
+    {
+      double t = NsTime::fromTimesteps (s->time).seconds () + delay;
+      if (t < now)
+	switch (latePolicy)
+	  {
+	  case LATE_DROP:
+	    ++pop->nLateDropped;
+	    continue;
+	  case LATE_CLAMP:
+	    ++pop->nLateClamped;
+	    t = now;
+	    break;
+	  default:
+	    ++pop->nLatePassed;
+	  }
+      pop->out->insertEvent (t, MUSIC::GlobalIndex (s->id));
+      ++pop->nInserted;
+      if (!inserted.empty () && inserted.back ().first == s->time)
+	++inserted.back ().second;
+      else
+	inserted.push_back (std::make_pair (s->time, 1u));
+    }
+  released.clear ();
+}
+
+
+// Synchronize clock with SpiNNaker.  Called by the tick thread.
+void
+MusicOutputAdapter::updateClock ()
+{
+  SyncSample sample;
+  bool fresh = false;
+  while (syncSamples.pop (sample))
+    {
+      clockSync.addSample (sample.host.seconds (),
+			   NsTime::fromTimesteps (sample.time).seconds ());
+      fresh = true;
+    }
+  if (!fresh)
+    return;
+  if (syncWindow == 0 || !clockSync.fit ())
+    {
+      // Set the clock from the latest timestep
+      clock.setAt (NsTime::fromTimesteps (sample.time), sample.host);
+      return;
+    }
+
+  double host = RTClock::getTime ().seconds ();
+  double error = clockSync.estimate (host) - clock.time ();
+  double maxSlew = MAX_SLEW * clock.interval ();
+  double correction = error;
+  if (fabs (error) < SNAP_LIMIT)
+    correction = std::max (-maxSlew, std::min (maxSlew, error));
+  clock.slew (NsTime::fromSeconds (correction));
+
+  double offset = clockSync.offset (host);
+  if (fabs (offset) > fabs (maxOffset))
+    maxOffset = offset;
+  if (syncStats)
+    *syncStats << host << ',' << clockSync.estimate (host) << ','
+	       << offset << ',' << 1e6 * clockSync.drift () << ','
+	       << clockSync.residual () << ',' << correction << '\n';
+}
+
+
+// Update the rates sampled by MUSIC at the coming tick
+void
+MusicOutputAdapter::sampleRates ()
+{
+  for (std::vector<MOAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    if ((*pop)->rates)
+      (*pop)->rates->sample ();
+}
+
+
+// Record latency of spikes which left through the last tick
+void
+MusicOutputAdapter::recordTickLatency ()
+{
+  NsTime now = clock.relativeTime (RTClock::getTime ());
+  for (std::vector<std::pair<int, unsigned> >::iterator i = inserted.begin ();
+       i != inserted.end ();
+       ++i)
+    tickLatency.record ((now - NsTime::fromTimesteps (i->first)).ns (),
+			i->second);
+  inserted.clear ();
+}
+
+
+void
+MusicOutputAdapter::dumpLatency ()
+{
+  if (latencyFile.empty ())
+    return;
+  std::vector<const LatencyHistogram*> histograms;
+  histograms.push_back (&receiveLatency);
+  histograms.push_back (&tickLatency);
+  LatencyHistogram::dump (latencyFile, histograms);
+}
+
+
+void
+MusicOutputAdapter::setReplay (SpikeReplay* replay_, bool fast)
+{
+  replay = replay_;
+  fastReplay = fast;
+  replayPopulations.clear ();
+  if (!replay->isLog ())
+    {
+      // Text files hold a single population
+      replayPopulations.push_back (populations[0]);
+      return;
+    }
+  const std::vector<LogPopulation>& logged = replay->populations ();
+  for (size_t i = 0; i < logged.size (); ++i)
+    {
+      std::map<std::string, MOAPopulation*>::iterator p
+	= byLabel.find (logged[i].label);
+      replayPopulations.push_back (p == byLabel.end () ? NULL : p->second);
+    }
+}
+
+
+// Move replayed spikes up to SpiNNaker timestep limit directly into
+// the reorder buffers.  Called by the tick thread.
+void
+MusicOutputAdapter::replayUntil (int limit)
+{
+  ReplaySpike s;
+  while (replay->peek (s) && s.time.timesteps () <= limit)
+    {
+      replay->next (s);
+      MOAPopulation* pop = replayPopulations[s.population];
+      if (pop == NULL)
+	continue;
+      if (pop->rates)
+	pop->rates->count (s.id);
+      if (pop->out == NULL
+	  || (unsigned) (s.id - pop->first) >= (unsigned) pop->count)
+	continue;
+      StagedSpike spike = { (int) s.time.timesteps (), s.id };
+      pop->reorder.add (spike);
+    }
+}
+
+
+void*
+MusicOutputAdapter::replayThread (void* arg)
+{
+  static_cast<MusicOutputAdapter*> (arg)->replay_loop ();
+  return NULL;
+}
+
+
+void
+MusicOutputAdapter::startReplay ()
+{
+  replayRunning = true;
+  if (pthread_create (&replayer, NULL, replayThread, this) != 0)
+    throw std::runtime_error ("failed to create replay thread");
+}
+
+
+void
+MusicOutputAdapter::stopReplay ()
+{
+  if (!replayRunning)
+    return;
+  replayRunning = false;
+  pthread_join (replayer, NULL);
+}
+
+
+// Replay thread: stands in for the SpiNNaker receive thread and
+// passes on spikes at their recorded arrival times
+void
+MusicOutputAdapter::replay_loop ()
+{
+  // The replay thread stands in for the receive thread, so
+  // receive_spikes () needn't place it again
+  placeThread (placements, "receive", reportPlacement, "MI: ");
+  receivePlaced = true;
+  // Longest sleep, so that stopReplay () doesn't wait for long gaps
+  const NsTime MAX_SLEEP = NsTime (100000000);
+  RTClock pace (clock.interval ());
+  pace.setSpinMargin (0.0);
+  NsTime start = RTClock::getTime ();
+  NsTime origin;
+  bool first = true;
+  std::vector<int> spikes;
+  ReplaySpike s, more;
+  while (replayRunning && replay->next (s))
+    {
+      if (first)
+	{
+	  origin = s.host;
+	  first = false;
+	}
+      // Spikes which arrived together are passed on together
+      spikes.assign (1, s.id);
+      while (replay->peek (more)
+	     && more.host == s.host
+	     && more.time == s.time
+	     && more.population == s.population)
+	{
+	  spikes.push_back (more.id);
+	  replay->next (more);
+	}
+      MOAPopulation* pop = replayPopulations[s.population];
+      if (pop == NULL)
+	continue;
+      NsTime due = start + (s.host - origin);
+      NsTime now;
+      while (replayRunning && (now = RTClock::getTime ()) < due)
+	pace.waitUntil (std::min (due, now + MAX_SLEEP));
+      receive_spikes ((char*) pop->label.c_str (), s.time.timesteps (),
+		      spikes.size (), &spikes[0]);
+    }
+}
+
+
+// Replay as fast as MUSIC accepts the spikes
+void
+MusicOutputAdapter::main_loop_fast ()
+{
+  while (runtime->time () < stoptime)
+    {
+      replayUntil (tickLimit ());
+      for (std::vector<MOAPopulation*>::iterator pop = populations.begin ();
+	   pop != populations.end ();
+	   ++pop)
+	insertStaged (*pop);
+      sampleRates ();
+      runtime->tick ();
+      // Latencies mean nothing here
+      inserted.clear ();
     }
-  pthread_mutex_unlock (&(this->music_mutex));
 }
 
 
 void MusicOutputAdapter::main_loop() {
+  prepareRealtime ();
+  if (replay && fastReplay)
+    {
+      main_loop_fast ();
+      report ();
+      return;
+    }
   clock.resetAndStop ();
-  waitForStart ();
+  if (!replay && !waitForStart ())
+    {
+      control.finished ();
+      return;
+    }
   clock.start ();
+  followClock ();
+  if (replay)
+    startReplay ();
   while (clock.time () < stoptime)
     {
       clock.setNextTarget ();
-      while (!clock.pastTarget ())
-	{
-	  if (isStopping)
-	    goto stop;
-	  sched_yield ();
-	}
-      pthread_mutex_lock (&(this->music_mutex));
+      // After a pause, the next segment picks up at the same target
+      while (!waitForTarget ())
+	if (!pause ())
+	  goto stop;
+      beforeTick ();
       runtime->tick ();
-      pthread_mutex_unlock (&(this->music_mutex));
-      continue;
-      
-    stop:
-      clock.stop ();
-      stop ();
-      break;
+      afterTick ();
+    }
+ stop:
+  // A stop request after the end needn't wait
+  control.finished ();
+  stopReplay ();
+  finish ();
+}
+
+
+// SpiNNaker has paused or stopped, or a shutdown signal arrived.
+// With run segments, hold the clock, queues and MUSIC until the next
+// start.  Return false if the main loop should end.
+bool
+MusicOutputAdapter::pause ()
+{
+  clock.stop ();
+  stop ();
+  if (!segments || !waitForStart ())
+    return false;
+  resync ();
+  clock.start ();
+  followClock ();
+  return true;
+}
+
+
+void
+MusicOutputAdapter::resync ()
+{
+  // Host time has moved on during the pause, SpiNNaker time hasn't
+  SyncSample sample;
+  while (syncSamples.pop (sample))
+    ;
+  clockSync.restart ();
+}
+
+
+void
+MusicOutputAdapter::followClock ()
+{
+  clockStart.store (clock.absoluteTime (NsTime ()).ns (),
+		    std::memory_order_release);
+}
+
+
+void
+MusicOutputAdapter::beforeTick ()
+{
+  updateClock ();
+  followClock ();
+  for (std::vector<MOAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    insertStaged (*pop);
+  sampleRates ();
+}
+
+
+void
+MusicOutputAdapter::afterTick ()
+{
+  recordTickLatency ();
+  // When hosted, the bridge dumps the histograms of both adapters
+  if (!hosted && LatencyHistogram::dumpRequested ())
+    dumpLatency ();
+}
+
+
+void
+MusicOutputAdapter::finish ()
+{
+  if (recorder)
+    recorder->close ();
+  report ();
+}
+
+
+void
+MusicOutputAdapter::report ()
+{
+  if (control.segment () > 1)
+    std::cerr << "MI: ran " << control.segment () << " segments\n";
+  std::cerr << "MI: tick thread woke " << 1e6 * clock.meanLateness ()
+	    << " us late on average, " << 1e6 * clock.maxLateness ()
+	    << " us at most (" << clock.nWaits () << " waits)\n";
+  clock.overrunSummary (std::cerr, "MI: ");
+  if (syncWindow > 0 && clockSync.nSamples () > 0)
+    std::cerr << "MI: SpiNNaker clock drift " << 1e6 * clockSync.drift ()
+	      << " ppm, largest offset " << 1e3 * maxOffset
+	      << " ms, fit residual " << 1e3 * clockSync.residual ()
+	      << " ms\n";
+  for (std::vector<MOAPopulation*>::iterator p = populations.begin ();
+       p != populations.end ();
+       ++p)
+    {
+      MOAPopulation* pop = *p;
+      std::cerr << "MI: " << pop->label << ": inserted " << pop->nInserted
+		<< " spikes, late: " << pop->nLatePassed << " passed on, "
+		<< pop->nLateClamped << " clamped, "
+		<< pop->nLateDropped << " dropped\n";
+      if (pop->nDropped > 0)
+	std::cerr << "MI: " << pop->label << ": dropped " << pop->nDropped
+		  << " spikes because the staging area was full\n";
+      if (pop->reorder.reordered () > 0)
+	std::cerr << "MI: " << pop->label << ": "
+		  << pop->reorder.reordered ()
+		  << " spikes arrived out of order\n";
+    }
+  if (recorder)
+    {
+      std::cerr << "MI: recorded " << recorder->nRecorded ()
+		<< " spikes to " << recorder->file () << '\n';
+      if (recorder->nLost () > 0)
+	std::cerr << "MI: " << recorder->nLost ()
+		  << " spikes lost because the spike log writer fell behind\n";
     }
+  receiveLatency.summary (std::cerr, "MI: ");
+  tickLatency.summary (std::cerr, "MI: ");
+  dumpLatency ();
+  std::cerr << "MI: used " << RTClock::cpuTime () << " s CPU time\n";
+  RTClock::sourceSummary (std::cerr, "MI: ");
 }
 
 
 MusicOutputAdapter::~MusicOutputAdapter()
 {
+  for (std::vector<MOAPopulation*>::iterator pop = populations.begin ();
+       pop != populations.end ();
+       ++pop)
+    delete *pop;
+  delete syncStats;
+  delete recorder;
 }
@@ -1,7 +1,7 @@
 /*
  *  This file is part of spinnaker-adapters
  *
- *  Copyright (C) 2017, 2018, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -22,15 +22,68 @@
 #define MUSICOUTPUTADAPTER_H
 
 #include "rtclock.h"
+#include "ClockSync.h"
+#include "EventLoop.h"
+#include "LatencyHistogram.h"
+#include "Population.h"
+#include "RateEstimator.h"
+#include "ReorderBuffer.h"
+#include "SpikeLog.h"
+#include "SpscRing.h"
+#include "ThreadPlacement.h"
 #include <SpynnakerLiveSpikesConnection.h>
 #include <map>
 #include <deque>
+#include <fstream>
+#include <atomic>
 #include <set>
 #include <pthread.h>
 #include <music.hh>
 
 using namespace MUSIC;
 
+// First arrival of a SpiNNaker timestep
+struct SyncSample
+{
+  int time; // SpiNNaker timestep
+  NsTime host;
+};
+
+// A population relayed from SpiNNaker to MUSIC
+struct MOAPopulation
+{
+  MOAPopulation (const PopulationSpec& spec, size_t capacity, int reorderWindow)
+    : label (spec.label), out (0), rateOut (0), rates (0), first (0), count (0),
+      recordBase (0), staging (capacity), reorder (reorderWindow),
+      nDropped (0), nInserted (0), nLatePassed (0), nLateDropped (0),
+      nLateClamped (0) { }
+  ~MOAPopulation () { delete rates; }
+
+  std::string label;
+  EventOutputPort* out;		// NULL if only rates are relayed
+
+  // Rates, NULL unless relayed
+  ContOutputPort* rateOut;
+  RateEstimator* rates;
+
+  // Slice of the population owned by this rank
+  int first;
+  int count;
+
+  // Key of neuron 0 in the spike log
+  uint32_t recordBase;
+
+  // Written by the SpiNNaker receive thread, read by the tick thread
+  SpscRing<StagedSpike> staging;
+  ReorderBuffer reorder;
+
+  unsigned long nDropped;
+  unsigned long nInserted;
+  unsigned long nLatePassed;
+  unsigned long nLateDropped;
+  unsigned long nLateClamped;
+};
+
 class MusicOutputAdapter
 : public SpikeReceiveCallbackInterface,
   public SpikesStartCallbackInterface,
@@ -43,11 +96,38 @@ public:
 			double timestep,
 			double delay,
 			double stopTime,
-			std::string label,
-			int nUnits,
-			std::string portName,
-			bool useBarrier = false);
+			const PopulationSpecs& populations,
+			bool useBarrier = false,
+			double spinMargin = -1.0,
+			int syncWindow = 0,
+			std::string syncStatsFile = "",
+			int reorderWindow = 0,
+			std::string latePolicy = "count",
+			std::string latencyFile = "",
+			std::string recordFile = "",
+			double rateWindow = 0.0,
+			int groupSize = 1,
+			bool events = true,
+			std::string overrunPolicy = "burst",
+			const ThreadPlacements& placements = ThreadPlacements (),
+			bool lockPages = false,
+			bool createRuntime = true);
     void main_loop();
+
+    /**
+     * Take spikes from a spike log or text file instead of SpiNNaker.
+     * With fast, they are relayed as fast as MUSIC accepts them,
+     * otherwise at the recorded arrival times.  Call before
+     * main_loop ().
+     */
+    void setReplay (SpikeReplay* replay, bool fast);
+
+    /**
+     * Treat a pause or stop of SpiNNaker as the end of a run segment
+     * and wait for the next start, instead of ending.  Call before
+     * main_loop ().
+     */
+    void setSegments (bool segments_) { segments = segments_; }
     virtual void spikes_start (char *label,
 			       SpynnakerLiveSpikesConnection *connection);
     virtual void spikes_stop (char *label,
@@ -58,21 +138,119 @@ public:
 				int* spikes);
     virtual ~MusicOutputAdapter();
 
+    /**
+     * Hosting by spinnmusic-bridge, which creates the Runtime (pass
+     * createRuntime false to the constructor) and ticks MUSIC for both
+     * directions.  The bridge runs on tickClock (), which this adapter
+     * keeps synchronized with SpiNNaker.
+     */
+    void attach (Runtime* runtime_) { runtime = runtime_; }
+    RTClock& tickClock () { return clock; }
+
+    /**
+     * Publish time 0 of tickClock () to the receive thread.  Call
+     * after starting the clock.
+     */
+    void followClock ();
+    void prepareRealtime ();
+
+    /**
+     * Before the clock restarts after a pause: forget the
+     * synchronization with SpiNNaker from before the pause
+     */
+    void resync ();
+
+    /**
+     * Before a tick: synchronize the clock and hand the spikes which
+     * must leave through the tick to MUSIC
+     */
+    void beforeTick ();
+
+    /**
+     * After a tick: record latencies
+     */
+    void afterTick ();
+
+    /**
+     * Write the latency histograms to the latency file, if any
+     */
+    void dumpLatency ();
+
+    /**
+     * Close the spike log and report
+     */
+    void finish ();
+
 private:
 
-    void waitForStart ();
+    bool waitForStart ();
+    bool waitForTarget ();
+    bool pause ();
+    void main_loop_fast ();
+    int tickLimit ();
+    void replayUntil (int limit);
+    void startReplay ();
+    void stopReplay ();
+    static void* replayThread (void* arg);
+    void replay_loop ();
     void stop ();
+    void report ();
+    void insertStaged (MOAPopulation* pop);
+    void updateClock ();
+    void sampleRates ();
+    void recordTickLatency ();
     
     Runtime* runtime;
-    EventOutputPort* out;
+    bool hosted;			// by spinnmusic-bridge
+    bool segments;		// run segments, see setSegments ()
+    std::vector<MOAPopulation*> populations;
+    std::map<std::string, MOAPopulation*> byLabel;
     RTClock clock;
+    std::atomic<int64_t> clockStart; // ns, time 0 of clock
     double delay;
-    bool isStopping;
+    EventLoop loop;		// of the tick thread
+    RunControl control;
     double stoptime;
 
+    // Synchronization with the SpiNNaker clock.  With syncWindow 0,
+    // the clock is set at the arrival of every timestep.
+    SpscRing<SyncSample> syncSamples;
+    int lastSampleTime;		// used by the receive thread
+    int syncWindow;
+    ClockSync clockSync;
+    std::ofstream* syncStats;
+    double maxOffset;
+
+    // Time ordering of spikes and handling of spikes which are too
+    // late for MUSIC
+    enum LatePolicy { LATE_COUNT, LATE_DROP, LATE_CLAMP };
+    std::vector<StagedSpike> released;
+    LatePolicy latePolicy;
+
+    // SpiNNaker time versus arrival and versus leaving through tick ()
+    LatencyHistogram receiveLatency;
+    LatencyHistogram tickLatency;
+    std::vector<std::pair<int, unsigned> > inserted; // timestep, count
+    std::string latencyFile;
+
+    // Written by the receive thread, NULL unless recording
+    SpikeRecorder* recorder;
+
+    // Replay, NULL unless replaying.  replayPopulations maps
+    // populations of the replayed file to ours (NULL if not relayed).
+    SpikeReplay* replay;
+    bool fastReplay;
+    std::vector<MOAPopulation*> replayPopulations;
+    pthread_t replayer;
+    std::atomic<bool> replayRunning;
+
+    // CPUs and scheduling of the tick and receive threads
+    ThreadPlacements placements;
+    bool lockPages;
+    bool reportPlacement;
+    bool receivePlaced;		// used by the receive thread
+
     pthread_mutex_t music_mutex;
-    pthread_mutex_t start_mutex;
-    pthread_cond_t start_condition;
 };
 
 #endif /* MUSICOUTPUTADAPTER_H */
@@ -0,0 +1,80 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/**
+ * A SpiNNaker population relayed through a MUSIC port
+ */
+struct PopulationSpec
+{
+  std::string label;
+  int nUnits;
+  std::string portName;
+};
+
+typedef std::vector<PopulationSpec> PopulationSpecs;
+
+/**
+ * Parse LABEL:N[:PORTNAME] into spec.  The port name defaults to
+ * the label.  Return false if arg is malformed.
+ */
+inline bool
+parsePopulation (const std::string& arg, PopulationSpec& spec)
+{
+  std::string::size_type colon1 = arg.find (':');
+  if (colon1 == std::string::npos || colon1 == 0)
+    return false;
+  std::string::size_type colon2 = arg.find (':', colon1 + 1);
+  std::string n = arg.substr (colon1 + 1,
+			      colon2 == std::string::npos
+			      ? std::string::npos
+			      : colon2 - colon1 - 1);
+  spec.label = arg.substr (0, colon1);
+  spec.nUnits = atoi (n.c_str ());
+  if (spec.nUnits <= 0)
+    return false;
+  if (colon2 == std::string::npos)
+    spec.portName = spec.label;
+  else
+    spec.portName = arg.substr (colon2 + 1);
+  return !spec.portName.empty ();
+}
+
+/**
+ * Compute the slice [first, first + count) of a population of size n
+ * owned by rank out of size ranks.  Slices differ in size by at most
+ * one.
+ */
+inline void
+partition (int n, int rank, int size, int& first, int& count)
+{
+  int base = n / size;
+  int extra = n % size;
+  first = rank * base + (rank < extra ? rank : extra);
+  count = base + (rank < extra ? 1 : 0);
+}
+
+#endif /* POPULATION_H */
@@ -0,0 +1,69 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include "RateEstimator.h"
+
+RateEstimator::RateEstimator (int nUnits,
+			      int groupSize,
+			      int first,
+			      int count,
+			      int windowTicks,
+			      double tickInterval)
+  : groupSize_ (groupSize), first_ (first), nGroups_ (count),
+    window_ (windowTicks), pos_ (0),
+    sampled_ (count), bins_ (count * windowTicks), sums_ (count),
+    scale_ (count), rates_ (std::max (count, 1))
+{
+  if (groupSize <= 0 || windowTicks <= 0 || tickInterval <= 0.0)
+    throw std::runtime_error ("bad rate estimator parameters");
+  counts_ = new std::atomic<uint32_t>[std::max (count, 1)];
+  for (int g = 0; g < count; ++g)
+    {
+      counts_[g] = 0;
+      int neurons = std::min (groupSize, nUnits - (first + g) * groupSize);
+      scale_[g] = 1.0 / (neurons * windowTicks * tickInterval);
+    }
+}
+
+
+RateEstimator::~RateEstimator ()
+{
+  delete[] counts_;
+}
+
+
+void
+RateEstimator::sample ()
+{
+  uint32_t* bin = &bins_[pos_ * nGroups_];
+  for (int g = 0; g < nGroups_; ++g)
+    {
+      // Unsigned arithmetic survives wraparound of the counts
+      uint32_t total = counts_[g].load (std::memory_order_relaxed);
+      uint32_t n = total - sampled_[g];
+      sampled_[g] = total;
+      sums_[g] += n - bin[g];
+      bin[g] = n;
+      rates_[g] = scale_[g] * sums_[g];
+    }
+  pos_ = (pos_ + 1) % window_;
+}
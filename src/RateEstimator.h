@@ -0,0 +1,87 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RATEESTIMATOR_H
+#define RATEESTIMATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/**
+ * Firing rates of groups of neurons, estimated from spike counts
+ * over a sliding window of ticks.
+ *
+ * Neurons are divided into consecutive groups of groupSize (the last
+ * one may be smaller) and the estimator covers groups [first, first
+ * + count).  count () is called from a single thread, such as the
+ * SpiNNaker receive thread, while sample () is called from the tick
+ * thread.  rates () then holds the mean rate per neuron of each
+ * group in Hz over the last windowTicks ticks.
+ */
+class RateEstimator
+{
+ public:
+  RateEstimator (int nUnits,
+		 int groupSize,
+		 int first,
+		 int count,
+		 int windowTicks,
+		 double tickInterval);
+  ~RateEstimator ();
+
+  /**
+   * Count a spike of neuron id.  Spikes of other ranks' groups are
+   * ignored.
+   */
+  void count (int id)
+  {
+    unsigned g = id / groupSize_ - first_;
+    if (g >= (unsigned) nGroups_)
+      return;
+    // Only one thread writes, so no atomic read-modify-write is needed
+    counts_[g].store (counts_[g].load (std::memory_order_relaxed) + 1,
+		      std::memory_order_relaxed);
+  }
+
+  /**
+   * Close the current bin and update rates ().
+   */
+  void sample ();
+
+  double* rates () { return &rates_[0]; }
+  int first () const { return first_; }
+  int size () const { return nGroups_; }
+
+ private:
+  int groupSize_;
+  int first_;
+  int nGroups_;
+  int window_;			// ticks
+  int pos_;			// current bin in window
+  std::atomic<uint32_t>* counts_; // cumulative, written by count ()
+  std::vector<uint32_t> sampled_; // counts_ at the last sample ()
+  std::vector<uint32_t> bins_;	// window_ bins per group
+  std::vector<uint32_t> sums_;	// sum of the bins of each group
+  std::vector<double> scale_;	// converts a sum into a rate
+  std::vector<double> rates_;
+};
+
+#endif /* RATEESTIMATOR_H */
@@ -0,0 +1,93 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REORDERBUFFER_H
+#define REORDERBUFFER_H
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+// Spike received from SpiNNaker, staged for insertion into MUSIC
+struct StagedSpike
+{
+  int time; // SpiNNaker timestep
+  int id;
+};
+
+/**
+ * Buffer which puts spikes received from SpiNNaker back in timestep
+ * order.
+ *
+ * A timestep is held until a spike window timesteps later has
+ * arrived, or until the caller forces it out.
+ */
+class ReorderBuffer
+{
+ public:
+  ReorderBuffer (int window)
+    : window_ (window), newest_ (-1), nReordered_ (0) { }
+
+  void add (const StagedSpike& spike)
+  {
+    if (spike.time > newest_)
+      newest_ = spike.time;
+    else if (spike.time < newest_)
+      ++nReordered_;
+    buffer_[spike.time].push_back (spike.id);
+  }
+
+  /**
+   * Append all spikes which are no longer held, and those with
+   * timestep <= limit, to out in timestep order.
+   */
+  void release (int limit, std::vector<StagedSpike>& out)
+  {
+    limit = std::max (limit, newest_ - window_);
+    while (!buffer_.empty () && buffer_.begin ()->first <= limit)
+      {
+	Buffer::iterator b = buffer_.begin ();
+	for (std::vector<int>::iterator id = b->second.begin ();
+	     id != b->second.end ();
+	     ++id)
+	  {
+	    StagedSpike spike = { b->first, *id };
+	    out.push_back (spike);
+	  }
+	buffer_.erase (b);
+      }
+  }
+
+  bool empty () const { return buffer_.empty (); }
+
+  /**
+   * Number of spikes which arrived after a later timestep.
+   */
+  unsigned long reordered () const { return nReordered_; }
+
+ private:
+  typedef std::map<int, std::vector<int> > Buffer;
+  int window_;
+  int newest_;
+  unsigned long nReordered_;
+  Buffer buffer_;
+};
+
+#endif /* REORDERBUFFER_H */
@@ -0,0 +1,124 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <math.h>
+#include <algorithm>
+#include "SpikeGenerator.h"
+
+// A neuron fires at most about once per timestep
+const double MAX_PER_STEP = 1.0;
+
+
+static uint64_t
+splitmix64 (uint64_t& x)
+{
+  uint64_t z = (x += UINT64_C (0x9e3779b97f4a7c15));
+  z = (z ^ (z >> 30)) * UINT64_C (0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C (0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+
+SpikeGenerator::SpikeGenerator (int first, int count, Pattern pattern,
+				uint64_t seed)
+  : first_ (first), count_ (count), pattern_ (pattern),
+    rates_ (count > 0 ? count : 1), integral_ (count), threshold_ (count),
+    nGenerated_ (0)
+{
+  for (int i = 0; i < 4; ++i)
+    s_[i] = splitmix64 (seed);
+  for (int i = 0; i < count; ++i)
+    {
+      threshold_[i] = threshold ();
+      // Regular trains start at random phases
+      if (pattern_ == REGULAR)
+	integral_[i] = 1.0 - uniform ();
+    }
+}
+
+
+bool
+SpikeGenerator::parsePattern (const std::string& name, Pattern& pattern)
+{
+  if (name == "poisson")
+    pattern = POISSON;
+  else if (name == "regular")
+    pattern = REGULAR;
+  else
+    return false;
+  return true;
+}
+
+
+double
+SpikeGenerator::threshold ()
+{
+  return pattern_ == POISSON ? - log (uniform ()) : 1.0;
+}
+
+
+void
+SpikeGenerator::generate (int64_t from, int64_t to,
+			  std::vector<TimeIdPair>& out)
+{
+  double nSteps = to - from;
+  if (nSteps <= 0)
+    return;
+  double dt = NsTime::fromTimesteps (1).seconds ();
+  for (int i = 0; i < count_; ++i)
+    {
+      double r = rates_[i] * dt;
+      if (!(r > 0.0))		// also catches NaN
+	continue;
+      if (r > MAX_PER_STEP)
+	r = MAX_PER_STEP;
+      double integral = integral_[i] + r * nSteps;
+      if (integral < threshold_[i])
+	{
+	  integral_[i] = integral;
+	  continue;
+	}
+
+      // Walk from spike to spike.  pos steps have been integrated.
+      integral = integral_[i];
+      double thr = threshold_[i];
+      double pos = 0.0;
+      for (;;)
+	{
+	  double need = thr - integral;
+	  double steps = need > 0.0 ? ceil (need / r) : 0.0;
+	  if (pos + steps > nSteps)
+	    {
+	      integral += (nSteps - pos) * r;
+	      break;
+	    }
+	  pos += steps;
+	  integral += steps * r - thr;
+	  // The first spike needs at least one step, except after
+	  // rounding errors
+	  int64_t step = from + (int64_t) std::max (pos, 1.0) - 1;
+	  out.push_back (TimeIdPair (NsTime::fromTimesteps (step), first_ + i));
+	  ++nGenerated_;
+	  thr = threshold ();
+	}
+      integral_[i] = integral;
+      threshold_[i] = thr;
+    }
+}
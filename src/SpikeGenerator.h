@@ -0,0 +1,100 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPIKEGENERATOR_H
+#define SPIKEGENERATOR_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "SpikeQueue.h"
+
+/**
+ * Generates spike trains of neurons [first, first + count) from
+ * their rates, one SpiNNaker timestep at a time.
+ *
+ * Each neuron integrates rate * timestep and fires when the integral
+ * reaches a threshold, which is then subtracted.  With a threshold
+ * of 1 this gives regular trains; with thresholds drawn from Exp(1)
+ * it gives Poisson trains, also when the rate changes from tick to
+ * tick.  The common case of no spike during a call costs one
+ * multiply-add per neuron, and random numbers are only drawn per
+ * spike, so 100k neurons at 1 ms resolution are cheap.
+ */
+class SpikeGenerator
+{
+ public:
+  enum Pattern { POISSON, REGULAR };
+
+  SpikeGenerator (int first, int count, Pattern pattern, uint64_t seed);
+
+  /**
+   * Parse poisson or regular into pattern.  Return false if name is
+   * neither.
+   */
+  static bool parsePattern (const std::string& name, Pattern& pattern);
+
+  /**
+   * Rates in Hz, to be filled in by the caller (e.g. mapped onto a
+   * MUSIC ContInputPort)
+   */
+  double* rates () { return &rates_[0]; }
+
+  /**
+   * Append the spikes of SpiNNaker timesteps [from, to) to out.
+   * Spikes are timed at the start of their timestep.
+   */
+  void generate (int64_t from, int64_t to, std::vector<TimeIdPair>& out);
+
+  unsigned long nGenerated () const { return nGenerated_; }
+
+ private:
+  // xoshiro256+
+  uint64_t random ()
+  {
+    uint64_t result = s_[0] + s_[3];
+    uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = (s_[3] << 45) | (s_[3] >> 19);
+    return result;
+  }
+
+  double uniform ()		// in (0, 1]
+  {
+    return ((random () >> 11) + 1) * (1.0 / (UINT64_C (1) << 53));
+  }
+
+  double threshold ();
+
+  int first_;
+  int count_;
+  Pattern pattern_;
+  uint64_t s_[4];
+  std::vector<double> rates_;
+  std::vector<double> integral_;
+  std::vector<double> threshold_;
+  unsigned long nGenerated_;
+};
+
+#endif /* SPIKEGENERATOR_H */
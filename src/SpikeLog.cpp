@@ -0,0 +1,338 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <stdexcept>
+#include "SpikeLog.h"
+#include "rtclock.h"
+
+// Records per write () (1 MiB)
+const size_t WRITE_RECORDS = 1 << 16;
+
+// A partial buffer is written out after this long
+const NsTime FLUSH_INTERVAL = NsTime (100000000);
+
+// Sleep of the writer thread when the ring is empty
+const useconds_t IDLE_SLEEP = 1000;
+
+
+static void
+writeAll (int fd, const void* data, size_t n)
+{
+  const char* p = static_cast<const char*> (data);
+  while (n > 0)
+    {
+      ssize_t written = write (fd, p, n);
+      if (written < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  throw std::runtime_error (strerror (errno));
+	}
+      p += written;
+      n -= written;
+    }
+}
+
+
+SpikeRecorder::SpikeRecorder (const std::string& file,
+			      const PopulationSpecs& populations,
+			      size_t capacity)
+  : file_ (file), ring_ (capacity), buffer_ (WRITE_RECORDS), buffered_ (0),
+    nRecorded_ (0), lost_ (0), stopping_ (false), running_ (false)
+{
+  fd_ = open (file.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0)
+    throw std::runtime_error ("couldn't open " + file + ": "
+			      + strerror (errno));
+
+  std::string header (SPIKELOG_MAGIC, sizeof (SPIKELOG_MAGIC));
+  uint32_t words[3] = { SPIKELOG_VERSION, (uint32_t) populations.size () };
+  header.append ((const char*) words, 2 * sizeof (uint32_t));
+  uint32_t base = 0;
+  for (PopulationSpecs::const_iterator p = populations.begin ();
+       p != populations.end ();
+       ++p)
+    {
+      bases_.push_back (base);
+      words[0] = base;
+      words[1] = p->nUnits;
+      words[2] = p->label.size ();
+      header.append ((const char*) words, sizeof (words));
+      header.append (p->label);
+      base += p->nUnits;
+    }
+  try
+    {
+      writeAll (fd_, header.data (), header.size ());
+    }
+  catch (std::runtime_error& e)
+    {
+      ::close (fd_);
+      throw std::runtime_error ("couldn't write " + file + ": " + e.what ());
+    }
+
+  if (pthread_create (&writer_, NULL, writerThread, this) != 0)
+    {
+      ::close (fd_);
+      throw std::runtime_error ("failed to start spike log writer");
+    }
+  running_ = true;
+}
+
+
+SpikeRecorder::~SpikeRecorder ()
+{
+  close ();
+}
+
+
+void*
+SpikeRecorder::writerThread (void* arg)
+{
+  static_cast<SpikeRecorder*> (arg)->writer_loop ();
+  return NULL;
+}
+
+
+// Move records from the ring to the buffer, writing full buffers.
+// Return false if the ring was empty.
+bool
+SpikeRecorder::drain ()
+{
+  bool any = false;
+  while (ring_.pop (buffer_[buffered_]))
+    {
+      any = true;
+      if (++buffered_ == buffer_.size ())
+	flush ();
+    }
+  return any;
+}
+
+
+void
+SpikeRecorder::flush ()
+{
+  if (buffered_ == 0)
+    return;
+  if (fd_ >= 0)
+    try
+      {
+	writeAll (fd_, &buffer_[0], buffered_ * sizeof (SpikeRecord));
+	nRecorded_ += buffered_;
+      }
+    catch (std::runtime_error& e)
+      {
+	// Keep emptying the ring, but stop writing
+	std::cerr << "spike log " << file_ << ": write failed: " << e.what ()
+		  << '\n';
+	::close (fd_);
+	fd_ = -1;
+      }
+  if (fd_ < 0)
+    lost_.fetch_add (buffered_, std::memory_order_relaxed);
+  buffered_ = 0;
+}
+
+
+void
+SpikeRecorder::writer_loop ()
+{
+  NsTime lastFlush = RTClock::getTime ();
+  while (!stopping_.load (std::memory_order_acquire))
+    {
+      if (!drain ())
+	usleep (IDLE_SLEEP);
+      if (buffered_ > 0 && RTClock::getTime () - lastFlush > FLUSH_INTERVAL)
+	{
+	  flush ();
+	  lastFlush = RTClock::getTime ();
+	}
+    }
+  drain ();
+  flush ();
+}
+
+
+void
+SpikeRecorder::close ()
+{
+  if (!running_)
+    return;
+  stopping_.store (true, std::memory_order_release);
+  pthread_join (writer_, NULL);
+  running_ = false;
+  if (fd_ >= 0)
+    ::close (fd_);
+  fd_ = -1;
+}
+
+
+SpikeReplay::SpikeReplay (const std::string& file)
+  : file_ (file), data_ (NULL), size_ (0), pos_ (0), isLog_ (false),
+    line_ (0), hasNext_ (false)
+{
+  int fd = open (file.c_str (), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error ("couldn't open " + file + ": "
+			      + strerror (errno));
+  struct stat st;
+  if (fstat (fd, &st) != 0)
+    {
+      ::close (fd);
+      throw std::runtime_error ("couldn't stat " + file + ": "
+				+ strerror (errno));
+    }
+  size_ = st.st_size;
+  if (size_ > 0)
+    {
+      void* p = mmap (NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED)
+	{
+	  ::close (fd);
+	  throw std::runtime_error ("couldn't map " + file + ": "
+				    + strerror (errno));
+	}
+      data_ = static_cast<const char*> (p);
+      // Spikes are read once, front to back
+      madvise (p, size_, MADV_SEQUENTIAL);
+    }
+  ::close (fd);
+
+  isLog_ = size_ >= sizeof (SPIKELOG_MAGIC)
+    && memcmp (data_, SPIKELOG_MAGIC, sizeof (SPIKELOG_MAGIC)) == 0;
+  if (isLog_)
+    readHeader ();
+}
+
+
+SpikeReplay::~SpikeReplay ()
+{
+  if (data_)
+    munmap ((void*) data_, size_);
+}
+
+
+void
+SpikeReplay::readHeader ()
+{
+  uint32_t words[3];
+  pos_ = sizeof (SPIKELOG_MAGIC);
+  if (pos_ + 2 * sizeof (uint32_t) > size_)
+    throw std::runtime_error (file_ + ": truncated spike log header");
+  memcpy (words, data_ + pos_, 2 * sizeof (uint32_t));
+  pos_ += 2 * sizeof (uint32_t);
+  if (words[0] != SPIKELOG_VERSION)
+    throw std::runtime_error (file_ + ": unsupported spike log version");
+  uint32_t n = words[1];
+  for (uint32_t i = 0; i < n; ++i)
+    {
+      if (pos_ + sizeof (words) > size_)
+	throw std::runtime_error (file_ + ": truncated spike log header");
+      memcpy (words, data_ + pos_, sizeof (words));
+      pos_ += sizeof (words);
+      if (pos_ + words[2] > size_)
+	throw std::runtime_error (file_ + ": truncated spike log header");
+      LogPopulation pop;
+      pop.label.assign (data_ + pos_, words[2]);
+      pop.base = words[0];
+      pop.size = words[1];
+      pos_ += words[2];
+      populations_.push_back (pop);
+    }
+}
+
+
+bool
+SpikeReplay::read (ReplaySpike& spike)
+{
+  return isLog_ ? readRecord (spike) : readLine (spike);
+}
+
+
+bool
+SpikeReplay::readRecord (ReplaySpike& spike)
+{
+  SpikeRecord r;
+  // A log cut short by a crash may end in a partial record
+  while (pos_ + sizeof (r) <= size_)
+    {
+      memcpy (&r, data_ + pos_, sizeof (r));
+      pos_ += sizeof (r);
+      for (size_t i = 0; i < populations_.size (); ++i)
+	if (r.key - populations_[i].base < populations_[i].size)
+	  {
+	    spike.time = NsTime::fromTimesteps (r.time);
+	    spike.host = NsTime (r.host);
+	    spike.population = i;
+	    spike.id = r.key - populations_[i].base;
+	    return true;
+	  }
+    }
+  return false;
+}
+
+
+bool
+SpikeReplay::readLine (ReplaySpike& spike)
+{
+  // Longest line accepted
+  const size_t MAX_LINE = 128;
+  char line[MAX_LINE];
+  while (pos_ < size_)
+    {
+      const char* start = data_ + pos_;
+      const char* end = static_cast<const char*> (memchr (start, '\n',
+							   size_ - pos_));
+      size_t length = end ? end - start : size_ - pos_;
+      pos_ += length + 1;
+      ++line_;
+      if (length >= MAX_LINE)
+	throw std::runtime_error (file_ + ":" + std::to_string (line_)
+				  + ": line too long");
+      // The map isn't NUL terminated, so parse a copy
+      memcpy (line, start, length);
+      line[length] = '\0';
+      char* p = line + strspn (line, " \t\r");
+      if (*p == '\0' || *p == '#')
+	continue;
+      char* rest;
+      char* idEnd;
+      double t = strtod (p, &rest);
+      long id = strtol (rest, &idEnd, 10);
+      if (rest == p || idEnd == rest || id < 0)
+	throw std::runtime_error (file_ + ":" + std::to_string (line_)
+				  + ": expected TIME ID");
+      spike.time = NsTime::fromSeconds (t);
+      spike.host = spike.time;
+      spike.population = 0;
+      spike.id = id;
+      return true;
+    }
+  return false;
+}
@@ -0,0 +1,209 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPIKELOG_H
+#define SPIKELOG_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "nstime.h"
+#include "Population.h"
+#include "SpscRing.h"
+
+/*
+ * Binary spike log format, in host byte order:
+ *
+ *   char     magic[8]		"SPNSPIKE"
+ *   uint32_t version		SPIKELOG_VERSION
+ *   uint32_t nPopulations
+ *   nPopulations times:
+ *     uint32_t base		first key of the population
+ *     uint32_t size
+ *     uint32_t labelLength
+ *     char     label[labelLength]
+ *   records (SpikeRecord) until the end of the file
+ *
+ * The key of a spike is base + neuron id, i.e. the populations are
+ * numbered consecutively in the order of the header.
+ */
+
+const char SPIKELOG_MAGIC[8] = { 'S', 'P', 'N', 'S', 'P', 'I', 'K', 'E' };
+const uint32_t SPIKELOG_VERSION = 1;
+
+struct SpikeRecord
+{
+  int64_t host;			// CLOCK_MONOTONIC receive time in ns
+  int32_t time;			// SpiNNaker timestep
+  uint32_t key;
+};
+
+/**
+ * Appends received spikes to a binary spike log.
+ *
+ * record () only pushes onto a ring buffer, so it is cheap enough
+ * for the SpiNNaker receive thread.  A writer thread empties the
+ * ring into large write () calls.  If it falls behind, spikes are
+ * counted as lost rather than blocking the caller.
+ */
+class SpikeRecorder
+{
+ public:
+  SpikeRecorder (const std::string& file,
+		 const PopulationSpecs& populations,
+		 size_t capacity = 1 << 20);
+  ~SpikeRecorder ();
+
+  /**
+   * Return the key of neuron id of population i
+   */
+  uint32_t key (int i, int id) const { return bases_[i] + id; }
+
+  /**
+   * Called by a single producer thread.
+   */
+  void record (NsTime host, int time, uint32_t key)
+  {
+    SpikeRecord r = { host.ns (), time, key };
+    if (!ring_.push (r))
+      lost_.fetch_add (1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Write out what remains in the ring and close the file.
+   */
+  void close ();
+
+  const std::string& file () const { return file_; }
+  uint64_t nRecorded () const { return nRecorded_; }
+  uint64_t nLost () const { return lost_.load (std::memory_order_relaxed); }
+
+ private:
+  static void* writerThread (void* arg);
+  void writer_loop ();
+  bool drain ();
+  void flush ();
+
+  std::string file_;
+  int fd_;
+  std::vector<uint32_t> bases_;
+  SpscRing<SpikeRecord> ring_;
+  std::vector<SpikeRecord> buffer_;
+  size_t buffered_;
+  uint64_t nRecorded_;
+  std::atomic<uint64_t> lost_;
+  std::atomic<bool> stopping_;
+  bool running_;
+  pthread_t writer_;
+};
+
+/**
+ * A population listed in the header of a spike log
+ */
+struct LogPopulation
+{
+  std::string label;
+  uint32_t base;
+  uint32_t size;
+};
+
+/**
+ * A spike read back by SpikeReplay
+ */
+struct ReplaySpike
+{
+  NsTime time;			// SpiNNaker or MUSIC time
+  NsTime host;			// receive time (= time for text files)
+  int population;		// index into populations ()
+  int id;
+};
+
+/**
+ * Reads spikes, in file order, from a memory mapped spike log or
+ * text file.
+ *
+ * Text files hold one spike per line, TIME ID with TIME in seconds,
+ * like the spikesN.dat files read by the MUSIC eventsource.  Empty
+ * lines and lines starting with # are skipped.  All spikes of a text
+ * file belong to population 0.
+ */
+class SpikeReplay
+{
+ public:
+  SpikeReplay (const std::string& file);
+  ~SpikeReplay ();
+
+  const std::string& file () const { return file_; }
+
+  /**
+   * Return true if the file is a binary spike log
+   */
+  bool isLog () const { return isLog_; }
+
+  /**
+   * Populations of a spike log; empty for text files
+   */
+  const std::vector<LogPopulation>& populations () const
+  {
+    return populations_;
+  }
+
+  /**
+   * Look at the next spike without consuming it.  Return false at
+   * the end of the file.
+   */
+  bool peek (ReplaySpike& spike)
+  {
+    if (!hasNext_)
+      hasNext_ = read (next_);
+    spike = next_;
+    return hasNext_;
+  }
+
+  /**
+   * Consume the next spike.  Return false at the end of the file.
+   */
+  bool next (ReplaySpike& spike)
+  {
+    bool more = peek (spike);
+    hasNext_ = false;
+    return more;
+  }
+
+ private:
+  void readHeader ();
+  bool read (ReplaySpike& spike);
+  bool readRecord (ReplaySpike& spike);
+  bool readLine (ReplaySpike& spike);
+
+  std::string file_;
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  bool isLog_;
+  std::vector<LogPopulation> populations_;
+  long line_;
+  ReplaySpike next_;
+  bool hasNext_;
+};
+
+#endif /* SPIKELOG_H */
@@ -0,0 +1,223 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include "SpikeQueue.h"
+
+namespace {
+  struct EarlierThan {
+    bool operator() (const TimeIdPair& a, const TimeIdPair& b) const
+    {
+      return a.time () < b.time ();
+    }
+  };
+}
+
+
+SpikeQueue*
+SpikeQueue::create (const std::string& type, NsTime resolution)
+{
+  if (type == "wheel")
+    return new TimingWheel (resolution);
+  else if (type == "heap")
+    return new HeapSpikeQueue ();
+  else
+    throw std::runtime_error ("unknown spike queue type: " + type);
+}
+
+
+void
+HeapSpikeQueue::popUntil (NsTime t, std::vector<TimeIdPair>& due)
+{
+  while (!heap_.empty () && heap_.top ().time () <= t)
+    {
+      due.push_back (heap_.top ());
+      heap_.pop ();
+    }
+}
+
+
+void
+HeapSpikeQueue::reserve (size_t n)
+{
+  // priority_queue hides its container, so build a new one around a
+  // reserved vector and move the spikes over
+  std::vector<TimeIdPair> spikes;
+  spikes.reserve (std::max (n, heap_.size ()));
+  std::priority_queue<TimeIdPair> heap (std::less<TimeIdPair> (),
+					std::move (spikes));
+  while (!heap_.empty ())
+    {
+      heap.push (heap_.top ());
+      heap_.pop ();
+    }
+  heap_.swap (heap);
+}
+
+
+bool
+HeapSpikeQueue::nextDue (NsTime* t) const
+{
+  if (heap_.empty ())
+    return false;
+  *t = heap_.top ().time ();
+  return true;
+}
+
+
+TimingWheel::TimingWheel (NsTime resolution, int nBuckets)
+  : resolution_ (resolution.ns ()),
+    buckets_ (nBuckets),
+    mask_ (nBuckets - 1),
+    current_ (0),
+    head_ (0),
+    size_ (0)
+{
+  if (resolution_ <= 0)
+    throw std::runtime_error ("timing wheel resolution must be positive");
+  if (nBuckets <= 0 || (nBuckets & (nBuckets - 1)) != 0)
+    throw std::runtime_error ("timing wheel size must be a power of two");
+}
+
+
+void
+TimingWheel::reserve (size_t n)
+{
+  // Spikes spread over the buckets which the wheel covers
+  size_t perBucket = n / buckets_.size () + 1;
+  for (std::vector<Bucket>::iterator b = buckets_.begin ();
+       b != buckets_.end ();
+       ++b)
+    b->reserve (perBucket);
+}
+
+
+void
+TimingWheel::insert (const TimeIdPair& spike, int64_t b)
+{
+  if (b <= current_)
+    {
+      // The current bucket is kept sorted.  Spikes mostly arrive in
+      // time order, so search from the end.
+      Bucket& bucket = buckets_[current_ & mask_];
+      Bucket::iterator pos = bucket.end ();
+      while (pos != bucket.begin () + head_
+	     && (pos - 1)->time () > spike.time ())
+	--pos;
+      bucket.insert (pos, spike);
+    }
+  else if (b > current_ + mask_)
+    overflow_.push (spike);
+  else
+    buckets_[b & mask_].push_back (spike);
+}
+
+
+void
+TimingWheel::push (const TimeIdPair& spike)
+{
+  insert (spike, bucketOf (spike.time ()));
+  ++size_;
+}
+
+
+void
+TimingWheel::refill ()
+{
+  while (!overflow_.empty ())
+    {
+      int64_t b = bucketOf (overflow_.top ().time ());
+      if (b > current_ + mask_)
+	break;
+      TimeIdPair spike = overflow_.top ();
+      overflow_.pop ();
+      insert (spike, b);
+    }
+}
+
+
+void
+TimingWheel::advance ()
+{
+  buckets_[current_ & mask_].clear ();
+  head_ = 0;
+  if (size_ == overflow_.size ())
+    {
+      // Nothing left in the wheel, jump to the first overflow spike
+      if (!overflow_.empty ())
+	current_ = bucketOf (overflow_.top ().time ());
+    }
+  else
+    ++current_;
+  refill ();
+  Bucket& bucket = buckets_[current_ & mask_];
+  std::stable_sort (bucket.begin (), bucket.end (), EarlierThan ());
+}
+
+
+void
+TimingWheel::popUntil (NsTime t, std::vector<TimeIdPair>& due)
+{
+  int64_t now = bucketOf (t);
+
+  // Release all buckets which are entirely in the past
+  while (current_ < now && size_ > 0)
+    {
+      Bucket& bucket = buckets_[current_ & mask_];
+      due.insert (due.end (), bucket.begin () + head_, bucket.end ());
+      size_ -= bucket.size () - head_;
+      advance ();
+    }
+  if (current_ < now)
+    current_ = now;		// queue is empty
+
+  // Release the due part of the current bucket
+  Bucket& bucket = buckets_[current_ & mask_];
+  while (head_ < bucket.size ()
+	 && bucket[head_].time () <= t)
+    {
+      due.push_back (bucket[head_++]);
+      --size_;
+    }
+  if (head_ > 0 && head_ == bucket.size ())
+    {
+      bucket.clear ();
+      head_ = 0;
+    }
+}
+
+
+bool
+TimingWheel::nextDue (NsTime* t) const
+{
+  if (size_ == 0)
+    return false;
+  const Bucket& bucket = buckets_[current_ & mask_];
+  if (head_ < bucket.size ())
+    *t = bucket[head_].time ();
+  else
+    // Nothing more in the current bucket, so nothing can be due
+    // before the next one starts
+    *t = NsTime ((current_ + 1) * resolution_);
+  return true;
+}
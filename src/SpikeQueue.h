@@ -0,0 +1,164 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPIKEQUEUE_H
+#define SPIKEQUEUE_H
+
+#include "nstime.h"
+#include <stdint.h>
+#include <queue>
+#include <string>
+#include <vector>
+
+#ifdef SPIKEQUEUE_STANDALONE
+// Lets the benchmarks use the queues without MUSIC and MPI
+typedef int SpikeIndex;
+#else
+#include <music.hh>
+typedef MUSIC::GlobalIndex SpikeIndex;
+#endif
+
+// Inner class used in priority queue
+class TimeIdPair
+{
+ public:
+
+  TimeIdPair () { }
+  TimeIdPair (NsTime time, SpikeIndex id) : time_ (time), id_ (id) { }
+
+  bool operator< (const TimeIdPair& right) const {
+    // Note that we use > here, since we want lowest items first
+    return time_ > right.time_;
+  }
+
+  NsTime time () const { return time_; }
+  SpikeIndex id () const { return id_; }
+
+ private:
+  NsTime time_;
+  SpikeIndex id_;
+};
+
+
+/**
+ * Queue of spikes waiting to be sent, ordered by time relative to
+ * the start of the simulation.
+ */
+class SpikeQueue
+{
+ public:
+  virtual ~SpikeQueue () { }
+
+  virtual void push (const TimeIdPair& spike) = 0;
+
+  virtual bool empty () const = 0;
+
+  virtual size_t size () const = 0;
+
+  /**
+   * Allocate room for about n spikes up front, so that pushing them
+   * later doesn't allocate.
+   */
+  virtual void reserve (size_t n) = 0;
+
+  /**
+   * Move all spikes with time <= t to the end of due.
+   */
+  virtual void popUntil (NsTime t, std::vector<TimeIdPair>& due) = 0;
+
+  /**
+   * Store a lower bound for the time of the next spike in t.
+   * Return false if the queue is empty.
+   */
+  virtual bool nextDue (NsTime* t) const = 0;
+
+  /**
+   * Create a queue of the given type ("wheel" or "heap").
+   * resolution is the bucket width of the timing wheel.
+   */
+  static SpikeQueue* create (const std::string& type, NsTime resolution);
+};
+
+
+/**
+ * The original binary heap, O (log n) per push and pop.
+ */
+class HeapSpikeQueue : public SpikeQueue
+{
+ public:
+  void push (const TimeIdPair& spike) { heap_.push (spike); }
+  bool empty () const { return heap_.empty (); }
+  size_t size () const { return heap_.size (); }
+  void reserve (size_t n);
+  void popUntil (NsTime t, std::vector<TimeIdPair>& due);
+  bool nextDue (NsTime* t) const;
+
+ private:
+  std::priority_queue<TimeIdPair> heap_;
+};
+
+
+/**
+ * Timing wheel (calendar queue) with one bucket per resolution
+ * interval.
+ *
+ * Push and pop are O (1) amortized.  Spikes further into the future
+ * than the wheel covers are kept in an overflow heap and moved into
+ * the wheel as it turns.  Spikes which are already late are put in
+ * the current bucket.  Only the current bucket is kept sorted, so
+ * spikes released from earlier buckets come out in bucket order.
+ */
+class TimingWheel : public SpikeQueue
+{
+ public:
+  /**
+   * nBuckets must be a power of two.
+   */
+  TimingWheel (NsTime resolution, int nBuckets = 4096);
+
+  void push (const TimeIdPair& spike);
+  bool empty () const { return size_ == 0; }
+  size_t size () const { return size_; }
+  void reserve (size_t n);
+  void popUntil (NsTime t, std::vector<TimeIdPair>& due);
+  bool nextDue (NsTime* t) const;
+
+ private:
+  typedef std::vector<TimeIdPair> Bucket;
+
+  int64_t bucketOf (NsTime t) const
+  {
+    return t.ns () / resolution_;
+  }
+
+  void insert (const TimeIdPair& spike, int64_t b);
+  void advance ();
+  void refill ();
+
+  int64_t resolution_;		// bucket width in ns
+  std::vector<Bucket> buckets_;
+  int64_t mask_;
+  int64_t current_;		// absolute index of current bucket
+  size_t head_;			// next spike to release in current bucket
+  size_t size_;
+  std::priority_queue<TimeIdPair> overflow_;
+};
+
+#endif /* SPIKEQUEUE_H */
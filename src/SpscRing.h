@@ -0,0 +1,92 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Lock-free ring buffer with a single producer thread and a single
+ * consumer thread.
+ */
+template<typename T>
+class SpscRing
+{
+ public:
+  /**
+   * capacity must be a power of two.
+   */
+  SpscRing (size_t capacity)
+    : buffer_ (capacity), mask_ (capacity - 1), head_ (0), tail_ (0)
+  {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+      throw std::runtime_error ("ring capacity must be a power of two");
+  }
+
+  /**
+   * Called by the producer.  Return false if the ring is full.
+   */
+  bool push (const T& x)
+  {
+    size_t tail = tail_.load (std::memory_order_relaxed);
+    if (tail - head_.load (std::memory_order_acquire) == buffer_.size ())
+      return false;
+    buffer_[tail & mask_] = x;
+    tail_.store (tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Called by the consumer.  Return false if the ring is empty.
+   */
+  bool pop (T& x)
+  {
+    size_t head = head_.load (std::memory_order_relaxed);
+    if (head == tail_.load (std::memory_order_acquire))
+      return false;
+    x = buffer_[head & mask_];
+    head_.store (head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty () const
+  {
+    return head_.load (std::memory_order_acquire)
+      == tail_.load (std::memory_order_acquire);
+  }
+
+  size_t capacity () const { return buffer_.size (); }
+
+ private:
+  std::vector<T> buffer_;
+  size_t mask_;
+  // Keep the indices on separate cache lines
+  char pad0_[64];
+  std::atomic<size_t> head_;
+  char pad1_[64 - sizeof (std::atomic<size_t>)];
+  std::atomic<size_t> tail_;
+  char pad2_[64 - sizeof (std::atomic<size_t>)];
+};
+
+#endif /* SPSCRING_H */
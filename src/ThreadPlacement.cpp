@@ -0,0 +1,166 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "ThreadPlacement.h"
+
+// Stack touched by placeThread (), so that the thread doesn't page
+// fault the first time it goes deep
+const size_t PREFAULT_STACK = 256 * 1024;
+const size_t PAGE = 4096;
+
+
+// The result only keeps the compiler from dropping the stores
+static char
+prefaultStack ()
+{
+  volatile char stack[PREFAULT_STACK];
+  for (size_t i = 0; i < PREFAULT_STACK; i += PAGE)
+    stack[i] = 0;
+  return stack[0];
+}
+
+
+// Format set as a list of ranges like 0-3,6
+static std::string
+cpuList (const cpu_set_t& set)
+{
+  std::ostringstream out;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (!CPU_ISSET (cpu, &set))
+	continue;
+      int last = cpu;
+      while (last + 1 < CPU_SETSIZE && CPU_ISSET (last + 1, &set))
+	++last;
+      if (!out.str ().empty ())
+	out << ',';
+      out << cpu;
+      if (last > cpu)
+	out << '-' << last;
+      cpu = last;
+    }
+  return out.str ();
+}
+
+
+static const char*
+policyName (int policy)
+{
+  switch (policy)
+    {
+    case SCHED_FIFO:
+      return "SCHED_FIFO";
+    case SCHED_RR:
+      return "SCHED_RR";
+    case SCHED_OTHER:
+      return "SCHED_OTHER";
+    default:
+      return "other scheduling";
+    }
+}
+
+
+void
+placeThread (const ThreadPlacements& placements,
+	     const std::string& thread,
+	     bool report,
+	     const std::string& prefix)
+{
+  pthread_t self = pthread_self ();
+  for (ThreadPlacements::const_iterator p = placements.begin ();
+       p != placements.end ();
+       ++p)
+    {
+      if (p->thread != thread)
+	continue;
+      if (p->cpu >= 0)
+	{
+	  cpu_set_t set;
+	  CPU_ZERO (&set);
+	  CPU_SET (p->cpu, &set);
+	  int err = pthread_setaffinity_np (self, sizeof (set), &set);
+	  if (err != 0)
+	    std::cerr << prefix << "couldn't move the " << thread
+		      << " thread to CPU " << p->cpu << ": " << strerror (err)
+		      << '\n';
+	}
+      if (p->priority > 0)
+	{
+	  struct sched_param param;
+	  memset (&param, 0, sizeof (param));
+	  param.sched_priority = p->priority;
+	  int err = pthread_setschedparam (self, SCHED_FIFO, &param);
+	  if (err != 0)
+	    std::cerr << prefix << "couldn't give the " << thread
+		      << " thread SCHED_FIFO priority " << p->priority << ": "
+		      << strerror (err) << '\n';
+	}
+    }
+  prefaultStack ();
+  if (!report)
+    return;
+
+  // What we got, which may differ from what was asked for
+  std::cerr << prefix << thread << " thread " << syscall (SYS_gettid);
+  cpu_set_t set;
+  if (pthread_getaffinity_np (self, sizeof (set), &set) == 0)
+    std::cerr << " on CPU " << cpuList (set);
+  int policy;
+  struct sched_param param;
+  if (pthread_getschedparam (self, &policy, &param) == 0)
+    {
+      std::cerr << ", " << policyName (policy);
+      if (policy == SCHED_FIFO || policy == SCHED_RR)
+	std::cerr << " priority " << param.sched_priority;
+    }
+  std::cerr << '\n';
+}
+
+
+void
+lockMemory (const std::string& prefix)
+{
+  if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+      std::cerr << prefix << "couldn't lock memory: " << strerror (errno)
+		<< '\n';
+      return;
+    }
+  std::ifstream status ("/proc/self/status");
+  std::string line;
+  while (std::getline (status, line))
+    if (line.compare (0, 6, "VmLck:") == 0)
+      {
+	std::cerr << prefix << "locked "
+		  << line.substr (line.find_first_not_of (" \t", 6))
+		  << " in memory\n";
+	return;
+      }
+}
@@ -0,0 +1,85 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/**
+ * CPU and scheduling of one of the adapter threads (tick, send or
+ * receive)
+ */
+struct ThreadPlacement
+{
+  std::string thread;
+  int cpu;			// -1: any CPU
+  int priority;			// SCHED_FIFO priority, 0: normal scheduling
+};
+
+typedef std::vector<ThreadPlacement> ThreadPlacements;
+
+/**
+ * Parse THREAD:CPU[:PRIORITY] into placement.  CPU may be empty to
+ * leave the CPU alone.  Return false if arg is malformed.
+ */
+inline bool
+parsePlacement (const std::string& arg, ThreadPlacement& placement)
+{
+  std::string::size_type colon1 = arg.find (':');
+  if (colon1 == std::string::npos || colon1 == 0)
+    return false;
+  std::string::size_type colon2 = arg.find (':', colon1 + 1);
+  std::string cpu = arg.substr (colon1 + 1,
+				colon2 == std::string::npos
+				? std::string::npos
+				: colon2 - colon1 - 1);
+  placement.thread = arg.substr (0, colon1);
+  if (placement.thread != "tick"
+      && placement.thread != "send"
+      && placement.thread != "receive")
+    return false;
+  placement.cpu = cpu.empty () ? -1 : atoi (cpu.c_str ());
+  placement.priority = (colon2 == std::string::npos
+			? 0
+			: atoi (arg.c_str () + colon2 + 1));
+  return placement.cpu >= -1 && placement.priority >= 0
+    && placement.priority <= 99;
+}
+
+/**
+ * Apply the placement of thread, if there is one, to the calling
+ * thread and touch its stack.  With report, write where the thread
+ * actually runs.  Failures are reported but not fatal.
+ */
+void placeThread (const ThreadPlacements& placements,
+		  const std::string& thread,
+		  bool report,
+		  const std::string& prefix);
+
+/**
+ * Lock all current and future pages of the process in memory.
+ * Failures are reported but not fatal.
+ */
+void lockMemory (const std::string& prefix);
+
+#endif /* THREADPLACEMENT_H */
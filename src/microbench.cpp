@@ -0,0 +1,353 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Micro-benchmarks of the primitives in the spinnmusic-out send
+// loop.  Needs neither MPI, MUSIC nor SpiNNaker.
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <getopt.h>
+}
+
+#include "SpikeGenerator.h"
+#include "SpikeQueue.h"
+#include "rtclock.h"
+
+// Spike send loop simulated by the queue benchmarks: every STEP one
+// batch of spikes arrives, most of them due about WINDOW later.
+const double STEP = 1e-3;
+const double WINDOW = 16e-3;
+
+// Number of precomputed random offsets
+const int N_OFFSETS = 1 << 16;
+
+// Keeps the compiler from removing the benchmarked code
+static volatile long sink;
+
+long nOps = 1000000;
+
+
+void
+usage ()
+{
+  std::cerr << "Usage: microbench [OPTION...]\n"
+	    << "`microbench' times RTClock and spike queue primitives and\n"
+	    << "prints benchmark,param,ops,ns_per_op lines.\n\n"
+	    << "  -n, --ops N             operations per benchmark (default "
+	    << nOps << ")\n"
+	    << "  -h, --help              print this help message\n";
+  exit (1);
+}
+
+
+void
+getargs (int argc, char* argv[])
+{
+  opterr = 0; // handle errors ourselves
+  while (1)
+    {
+      static struct option longOptions[] =
+	{
+	  {"ops",         required_argument, 0, 'n'},
+	  {"help",        no_argument,       0, 'h'},
+	  {0, 0, 0, 0}
+	};
+      /* `getopt_long' stores the option index here. */
+      int option_index = 0;
+
+      int c = getopt_long (argc, argv, "n:h",
+			   longOptions, &option_index);
+
+      /* detect the end of the options */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'n':
+	  nOps = atol (optarg);
+	  if (nOps <= 0)
+	    usage ();
+	  continue;
+	case '?':
+	case 'h':
+	default:
+	  usage ();
+	}
+    }
+  if (optind < argc)
+    usage ();
+}
+
+
+double
+elapsedNs (NsTime start)
+{
+  return (RTClock::getTime () - start).ns ();
+}
+
+
+void
+report (const std::string& name, const std::string& param, long ops,
+	double ns)
+{
+  std::cout << name << ',' << param << ',' << ops << ',' << ns / ops
+	    << std::endl;
+}
+
+
+void
+benchClock ()
+{
+  RTClock clock (STEP);
+  NsTime start, t;
+  long n = 0;
+
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += RTClock::getTime ().ns ();
+  report ("getTime", RTClock::source (), nOps, elapsedNs (start));
+
+  if (RTClock::setSource ("tsc"))
+    {
+      start = RTClock::getTime ();
+      for (long i = 0; i < nOps; ++i)
+	n += RTClock::getTime ().ns ();
+      report ("getTime", RTClock::source (), nOps, elapsedNs (start));
+      RTClock::setSource ("monotonic");
+    }
+
+  // The target is in the future, so pastTarget () always reads the clock
+  clock.set (-3600.0);
+  clock.setNextTarget ();
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += clock.pastTarget ();
+  report ("pastTarget", "", nOps, elapsedNs (start));
+
+  // Absolute times scattered around the target
+  std::vector<NsTime> times (N_OFFSETS);
+  for (int i = 0; i < N_OFFSETS; ++i)
+    times[i] = clock.target ()
+      + NsTime::fromSeconds (WINDOW * rand () / RAND_MAX - WINDOW / 2);
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += clock.pastTarget (times[i & (N_OFFSETS - 1)]);
+  report ("pastTarget", "now", nOps, elapsedNs (start));
+
+  // The same times relative to the start of the clock, compared to now
+  std::vector<NsTime> relative (N_OFFSETS);
+  for (int i = 0; i < N_OFFSETS; ++i)
+    relative[i] = clock.relativeTime (times[i]);
+  t = RTClock::getTime ();
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += clock.lessThanEql (relative[i & (N_OFFSETS - 1)], t);
+  report ("lessThanEql", "", nOps, elapsedNs (start));
+
+  std::vector<double> seconds (N_OFFSETS);
+  for (int i = 0; i < N_OFFSETS; ++i)
+    seconds[i] = 3600.0 * rand () / RAND_MAX;
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += NsTime::fromSeconds (seconds[i & (N_OFFSETS - 1)]).ns ();
+  report ("NsTime::fromSeconds", "", nOps, elapsedNs (start));
+
+  start = RTClock::getTime ();
+  for (long i = 0; i < nOps; ++i)
+    n += times[i & (N_OFFSETS - 1)].toTimespec ().tv_nsec;
+  report ("NsTime::toTimespec", "", nOps, elapsedNs (start));
+
+  sink = n;
+}
+
+
+/**
+ * Offsets from the current step of the spikes arriving in one step.
+ * perStep must divide N_OFFSETS.
+ */
+std::vector<NsTime>
+arrivals (const std::string& pattern, int perStep)
+{
+  std::vector<NsTime> offsets (N_OFFSETS);
+  for (int i = 0; i < N_OFFSETS; ++i)
+    {
+      double r = (double) rand () / RAND_MAX;
+      double offset;
+      if (pattern == "ordered")
+	// Within one step, arrival order is time order
+	offset = WINDOW + STEP * (i % perStep) / perStep;
+      else if (pattern == "jitter")
+	offset = WINDOW + STEP * r;
+      else if (pattern == "burst")
+	offset = WINDOW;
+      else // random
+	offset = 2 * WINDOW * r;
+      offsets[i] = NsTime::fromSeconds (offset);
+    }
+  return offsets;
+}
+
+
+/**
+ * Run the send loop simulation with std::priority_queue directly, as
+ * the original MusicInputAdapter did.
+ */
+double
+runPriorityQueue (int perStep, const std::vector<NsTime>& offsets,
+		  long& nSpikes)
+{
+  std::priority_queue<TimeIdPair> queue;
+  long n = 0;
+  int k = 0;
+  nSpikes = 0;
+  NsTime start = RTClock::getTime ();
+  for (long step = 0; nSpikes < nOps; ++step)
+    {
+      NsTime now = NsTime::fromTimesteps (step);
+      for (int i = 0; i < perStep; ++i, k = (k + 1) & (N_OFFSETS - 1))
+	queue.push (TimeIdPair (now + offsets[k], i));
+      while (!queue.empty () && queue.top ().time () <= now)
+	{
+	  n += queue.top ().id ();
+	  queue.pop ();
+	  ++nSpikes;
+	}
+    }
+  sink = n;
+  return elapsedNs (start);
+}
+
+
+/**
+ * Run the send loop simulation with a SpikeQueue
+ */
+double
+runSpikeQueue (const std::string& type, int perStep,
+	       const std::vector<NsTime>& offsets, long& nSpikes)
+{
+  SpikeQueue* queue = SpikeQueue::create (type, NsTime::fromTimesteps (1));
+  std::vector<TimeIdPair> due;
+  long n = 0;
+  int k = 0;
+  nSpikes = 0;
+  NsTime start = RTClock::getTime ();
+  for (long step = 0; nSpikes < nOps; ++step)
+    {
+      NsTime now = NsTime::fromTimesteps (step);
+      for (int i = 0; i < perStep; ++i, k = (k + 1) & (N_OFFSETS - 1))
+	queue->push (TimeIdPair (now + offsets[k], i));
+      due.clear ();
+      queue->popUntil (now, due);
+      for (std::vector<TimeIdPair>::iterator s = due.begin ();
+	   s != due.end ();
+	   ++s)
+	n += s->id ();
+      nSpikes += due.size ();
+    }
+  double ns = elapsedNs (start);
+  delete queue;
+  sink = n;
+  return ns;
+}
+
+
+void
+benchQueues ()
+{
+  static const char* patterns[] = { "ordered", "jitter", "burst", "random" };
+  // Approximate queue depths: spikes per step times WINDOW / STEP
+  static const int depths[] = { 16, 256, 4096, 65536 };
+  for (int p = 0; p < 4; ++p)
+    {
+      for (int d = 0; d < 4; ++d)
+	{
+	  int perStep = depths[d] * STEP / WINDOW + 0.5;
+	  std::vector<NsTime> offsets = arrivals (patterns[p], perStep);
+	  std::string param = std::string (patterns[p]) + "/"
+	    + std::to_string (depths[d]);
+	  long nSpikes;
+	  double ns = runPriorityQueue (perStep, offsets, nSpikes);
+	  report ("priority_queue", param, nSpikes, ns);
+	  ns = runSpikeQueue ("heap", perStep, offsets, nSpikes);
+	  report ("HeapSpikeQueue", param, nSpikes, ns);
+	  ns = runSpikeQueue ("wheel", perStep, offsets, nSpikes);
+	  report ("TimingWheel", param, nSpikes, ns);
+	}
+    }
+}
+
+
+/**
+ * Generate spikes for 100k neurons, one 10 ms tick at a time.  ops
+ * counts neuron-timesteps.
+ */
+void
+benchGenerator ()
+{
+  const int N_NEURONS = 100000;
+  const int STEPS_PER_TICK = 10;
+  static const char* patterns[] = { "poisson", "regular" };
+  static const double rates[] = { 1.0, 10.0, 100.0 };
+  std::vector<TimeIdPair> out;
+  for (int p = 0; p < 2; ++p)
+    for (int r = 0; r < 3; ++r)
+      {
+	SpikeGenerator::Pattern pattern;
+	SpikeGenerator::parsePattern (patterns[p], pattern);
+	SpikeGenerator generator (0, N_NEURONS, pattern, 1);
+	for (int i = 0; i < N_NEURONS; ++i)
+	  generator.rates ()[i] = rates[r];
+	long nTicks = std::max (1L, nOps / (N_NEURONS * STEPS_PER_TICK));
+	long n = 0;
+	NsTime start = RTClock::getTime ();
+	for (long tick = 0; tick < nTicks; ++tick)
+	  {
+	    out.clear ();
+	    generator.generate (tick * STEPS_PER_TICK,
+				(tick + 1) * STEPS_PER_TICK, out);
+	    n += out.size ();
+	  }
+	sink = n;
+	report ("SpikeGenerator",
+		std::string (patterns[p]) + "/" + std::to_string ((int) rates[r]),
+		nTicks * N_NEURONS * STEPS_PER_TICK, elapsedNs (start));
+      }
+}
+
+
+int
+main (int argc, char* argv[])
+{
+  getargs (argc, argv);
+  std::cout << "benchmark,param,ops,ns_per_op\n";
+  benchClock ();
+  benchQueues ();
+  benchGenerator ();
+  return 0;
+}
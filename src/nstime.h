@@ -0,0 +1,106 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NSTIME_H
+#define NSTIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Duration of one SpiNNaker timestep in nanoseconds
+const int64_t SPINNAKER_TIMESTEP_NS = 1000000;
+
+/**
+ * A time or duration in integer nanoseconds.
+ *
+ * Compared to struct timespec, comparisons and arithmetic are single
+ * integer operations.  The range is about +-292 years.
+ */
+class NsTime
+{
+ public:
+  constexpr NsTime () : ns_ (0) { }
+  constexpr explicit NsTime (int64_t ns) : ns_ (ns) { }
+
+  /**
+   * Convert from seconds, rounding to the nearest nanosecond.
+   */
+  static constexpr NsTime fromSeconds (double s)
+  {
+    return NsTime ((int64_t) (s >= 0.0 ? 1e9 * s + 0.5 : 1e9 * s - 0.5));
+  }
+
+  static constexpr NsTime fromTimesteps (int64_t steps)
+  {
+    return NsTime (steps * SPINNAKER_TIMESTEP_NS);
+  }
+
+  static constexpr NsTime fromTimespec (const struct timespec& t)
+  {
+    return NsTime ((int64_t) t.tv_sec * 1000000000 + t.tv_nsec);
+  }
+
+  constexpr int64_t ns () const { return ns_; }
+
+  constexpr double seconds () const { return 1e-9 * ns_; }
+
+  /**
+   * Return the number of whole timesteps, rounded downwards.
+   */
+  constexpr int64_t timesteps () const
+  {
+    return ns_ >= 0
+      ? ns_ / SPINNAKER_TIMESTEP_NS
+      : - ((- ns_ + SPINNAKER_TIMESTEP_NS - 1) / SPINNAKER_TIMESTEP_NS);
+  }
+
+  struct timespec toTimespec () const
+  {
+    struct timespec t;
+    t.tv_sec = ns_ / 1000000000;
+    t.tv_nsec = ns_ % 1000000000;
+    if (t.tv_nsec < 0)
+      {
+	--t.tv_sec;
+	t.tv_nsec += 1000000000;
+      }
+    return t;
+  }
+
+  NsTime& operator+= (NsTime d) { ns_ += d.ns_; return *this; }
+  NsTime& operator-= (NsTime d) { ns_ -= d.ns_; return *this; }
+
+  constexpr NsTime operator+ (NsTime d) const { return NsTime (ns_ + d.ns_); }
+  constexpr NsTime operator- (NsTime d) const { return NsTime (ns_ - d.ns_); }
+  constexpr NsTime operator- () const { return NsTime (- ns_); }
+  constexpr NsTime operator* (int64_t k) const { return NsTime (ns_ * k); }
+
+  constexpr bool operator== (NsTime t) const { return ns_ == t.ns_; }
+  constexpr bool operator!= (NsTime t) const { return ns_ != t.ns_; }
+  constexpr bool operator< (NsTime t) const { return ns_ < t.ns_; }
+  constexpr bool operator<= (NsTime t) const { return ns_ <= t.ns_; }
+  constexpr bool operator> (NsTime t) const { return ns_ > t.ns_; }
+  constexpr bool operator>= (NsTime t) const { return ns_ >= t.ns_; }
+
+ private:
+  int64_t ns_;
+};
+
+#endif /* NSTIME_H */
@@ -3,7 +3,7 @@
  *
  *  Realtime clock
  *
- *  Copyright (C) 2015, 2017, 2018, 2019, 2021, 2022, 2023 Mikael Djurfeldt
+ *  Copyright (C) 2015, 2017, 2018, 2019, 2021, 2022, 2023, 2026 Mikael Djurfeldt
  *
  *  rtclock is free software; you can redistribute it and/or modify it
  *  under the terms of the GNU General Public License as published by
@@ -21,13 +21,22 @@
  */
 
 #include "rtclock.h"
+#include "EventLoop.h"
+
+#include <errno.h>
+#include <sched.h>
+
+// Number of overruns kept by worstOverruns ()
+const size_t N_WORST_OVERRUNS = 8;
 
 RTClock::RTClock (double interval = 0.)
+  : spin_ (true), nWaits_ (0), overrunPolicy_ (OVERRUN_BURST),
+    synchronized_ (false), behind_ (false), nOverruns_ (0), nSkipped_ (0)
 {
 #ifndef CLOCK_GETTIME
   interval_ = timevalFromSeconds (interval);
 #else
-  interval_ = timespecFromSeconds (interval);
+  interval_ = NsTime::fromSeconds (interval);
 #endif
   reset ();
 }
@@ -38,15 +47,13 @@ RTClock::reset ()
 #ifndef CLOCK_GETTIME
   gettimeofday (&start_, 0);
 #else
-  if (clock_gettime (CLOCK_MONOTONIC, &start_) != 0)
-    throw std::runtime_error (std::string ("gettime() failed: ")
-			      + strerror (errno));  
+  start_ = getTime ();
 #endif
   gridtime_ = start_;
 }
 
 void
-RTClock::sync (RTClock& clock)
+RTClock::sync (const RTClock& clock)
 {
   start_ = clock.start_;
   gridtime_ = start_;
@@ -85,38 +92,274 @@ RTClock::sleepUntil (double t) const
 void
 RTClock::resetAndStop ()
 {
-  start_.tv_sec = start_.tv_nsec = 0;
-  gridtime_ = start_;
+  start_ = gridtime_ = NsTime ();
+  behind_ = false;
 }
 
+// While stopped, start_ and gridtime_ hold times relative to the
+// moment the clock was stopped
+
 void
 RTClock::stop ()
 {
-  if (clock_gettime (CLOCK_MONOTONIC, &offset_) != 0)
-    throw std::runtime_error (std::string ("gettime() failed: ")
-			      + strerror (errno));  
-  timespecsub (&start_, &offset_, &start_);
-  timespecsub (&gridtime_, &offset_, &gridtime_);
+  NsTime now = getTime ();
+  start_ -= now;
+  gridtime_ -= now;
 }
 
 void
 RTClock::start ()
 {
-  if (clock_gettime (CLOCK_MONOTONIC, &offset_) != 0)
-    throw std::runtime_error (std::string ("gettime() failed: ")
-			      + strerror (errno));  
-  timespecadd (&start_, &offset_, &start_);
-  timespecadd (&gridtime_, &offset_, &gridtime_);
+  NsTime now = getTime ();
+  start_ += now;
+  gridtime_ += now;
 }
 
 void
-RTClock::set (double time)
+RTClock::setNextTarget ()
+{
+  gridtime_ += interval_;
+  NsTime now = getTime ();
+  if (now < gridtime_)
+    {
+      behind_ = false;
+      return;
+    }
+
+  // The target has passed already: the last tick overran
+  NsTime overrun = now - gridtime_;
+  if (!behind_)
+    noteOverrun (now - start_, overrun);
+  switch (overrunPolicy_)
+    {
+    case OVERRUN_BURST:
+      behind_ = true;
+      break;
+    case OVERRUN_SKIP:
+      {
+	// Drop the grid points which have passed, but tick at the
+	// latest one now
+	int64_t n = overrun.ns () / interval_.ns ();
+	nSkipped_ += n;
+	gridtime_ += interval_ * n;
+	holdBack (interval_ * n);
+      }
+      break;
+    case OVERRUN_STRETCH:
+      gridtime_ += overrun;
+      holdBack (overrun);
+      break;
+    }
+}
+
+// Hold back time () by dt, which the ticks have given up.  The time
+// of a synchronized clock belongs to the external clock.
+void
+RTClock::holdBack (NsTime dt)
+{
+  if (synchronized_)
+    return;
+  start_ += dt;
+  heldBack_ += dt;
+}
+
+void
+RTClock::noteOverrun (NsTime time, NsTime amount)
 {
-  if (clock_gettime (CLOCK_MONOTONIC, &start_) != 0)
+  ++nOverruns_;
+  if (worst_.size () == N_WORST_OVERRUNS)
+    {
+      if (amount <= worst_.back ().amount)
+	return;
+      worst_.pop_back ();
+    }
+  std::vector<Overrun>::iterator pos = worst_.begin ();
+  while (pos != worst_.end () && pos->amount >= amount)
+    ++pos;
+  Overrun overrun = { time, amount };
+  worst_.insert (pos, overrun);
+}
+
+bool
+RTClock::parseOverrunPolicy (const std::string& name, OverrunPolicy& policy)
+{
+  if (name == "burst")
+    policy = OVERRUN_BURST;
+  else if (name == "skip")
+    policy = OVERRUN_SKIP;
+  else if (name == "stretch")
+    policy = OVERRUN_STRETCH;
+  else
+    return false;
+  return true;
+}
+
+void
+RTClock::overrunSummary (std::ostream& out, const std::string& prefix) const
+{
+  static const char* const names[] = { "burst", "skip", "stretch" };
+  out << prefix << nOverruns_ << " tick overruns (policy "
+      << names[overrunPolicy_];
+  if (nSkipped_ > 0)
+    out << ", " << nSkipped_ << " grid points skipped";
+  if (heldBack_ > NsTime ())
+    out << ", clock held back " << 1e3 * heldBack_.seconds () << " ms";
+  out << ")\n";
+  if (worst_.empty ())
+    return;
+  out << prefix << "worst overruns:";
+  for (size_t i = 0; i < worst_.size (); ++i)
+    out << (i > 0 ? "," : "") << ' ' << 1e3 * worst_[i].amount.seconds ()
+	<< " ms at " << worst_[i].time.seconds () << " s";
+  out << '\n';
+}
+
+void
+RTClock::setSpinMargin (double margin)
+{
+  spin_ = margin < 0.0;
+  if (!spin_)
+    spinMargin_ = NsTime::fromSeconds (margin);
+}
+
+void
+RTClock::waitUntil (NsTime deadline)
+{
+  NsTime now = getTime ();
+  if (now >= deadline)
+    return;
+  if (spin_)
+    {
+      do
+	{
+	  sched_yield ();
+	  now = getTime ();
+	}
+      while (now < deadline);
+    }
+  else
+    {
+      NsTime wake = deadline - spinMargin_;
+      if (now < wake)
+	{
+	  struct timespec req = wake.toTimespec ();
+	  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL)
+		 == EINTR)
+	    ;
+	}
+      do
+	now = getTime ();
+      while (now < deadline);
+    }
+  noteWait (now - deadline);
+}
+
+bool
+RTClock::waitUntil (NsTime deadline, EventLoop& loop)
+{
+  const int early = EventLoop::NOTIFIED | EventLoop::SIGNALLED;
+  NsTime now = getTime ();
+  if (now >= deadline)
+    return true;
+  if (spin_)
+    {
+      // Pick up what arrived before we started to spin
+      if (loop.poll () & early)
+	return false;
+      do
+	{
+	  sched_yield ();
+	  if (loop.notified ())
+	    return false;
+	  now = getTime ();
+	}
+      while (now < deadline);
+    }
+  else
+    {
+      NsTime wake = deadline - spinMargin_;
+      if (now < wake && (loop.wait (wake) & early))
+	return false;
+      do
+	{
+	  if (loop.notified ())
+	    return false;
+	  now = getTime ();
+	}
+      while (now < deadline);
+    }
+  noteWait (now - deadline);
+  return true;
+}
+
+void
+RTClock::noteWait (NsTime lateness)
+{
+  ++nWaits_;
+  totalLateness_ += lateness;
+  if (lateness > maxLateness_)
+    maxLateness_ = lateness;
+}
+
+double
+RTClock::cpuTime ()
+{
+  struct timespec t;
+  if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &t) != 0)
     throw std::runtime_error (std::string ("gettime() failed: ")
 			      + strerror (errno));
-  struct timespec t = timespecFromSeconds (time);
-  timespecsub (&start_, &t, &start_);
+  return NsTime::fromTimespec (t).seconds ();
+}
+
+bool
+RTClock::setSource (const std::string& source)
+{
+  if (source == "tsc")
+    return TscClock::enable ();
+  else if (source == "monotonic")
+    {
+      TscClock::disable ();
+      return true;
+    }
+  else
+    throw std::runtime_error ("unknown clock source: " + source);
+}
+
+const char*
+RTClock::source ()
+{
+  return TscClock::enabled () ? "tsc" : "monotonic";
+}
+
+void
+RTClock::sourceSummary (std::ostream& out, const std::string& prefix)
+{
+  out << prefix << "clock source " << source ();
+  // The TSC may have been calibrated and later abandoned
+  if (TscClock::frequency () > 0.0)
+    out << ", TSC " << 1e-9 * TscClock::frequency () << " GHz, at most "
+	<< 1e-3 * TscClock::maxDeviation ().ns ()
+	<< " us off CLOCK_MONOTONIC";
+  out << '\n';
+}
+
+void
+RTClock::set (double time)
+{
+  start_ = getTime () - NsTime::fromSeconds (time);
+}
+
+void
+RTClock::setAt (NsTime time, NsTime now)
+{
+  start_ = now - time;
+}
+
+void
+RTClock::slew (NsTime dt)
+{
+  start_ -= dt;
+  gridtime_ -= dt;
 }
 
 #endif
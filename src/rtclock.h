@@ -3,7 +3,7 @@
  *
  *  Realtime clock
  *
- *  Copyright (C) 2015, 2017, 2018, 2021, 2022, 2023 Mikael Djurfeldt
+ *  Copyright (C) 2015, 2017, 2018, 2021, 2022, 2023, 2026 Mikael Djurfeldt
  *
  *  rtclock is free software; you can redistribute it and/or modify it
  *  under the terms of the GNU General Public License as published by
@@ -25,40 +25,20 @@
 
 #define CLOCK_GETTIME
 
+#include <ostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <cstring>
 
+#include <errno.h>
 #include <time.h>
 #include <sys/time.h>
 
-#if defined (CLOCK_GETTIME) && !defined (timespecadd)
-
-# define timespeccmp(a, b, CMP) 				       	      \
-  (((a)->tv_sec == (b)->tv_sec) ? 					      \
-   ((a)->tv_nsec CMP (b)->tv_nsec) : 					      \
-   ((a)->tv_sec CMP (b)->tv_sec))
-# define timespecadd(a, b, result)	       				      \
-  do {									      \
-    (result)->tv_sec = (a)->tv_sec + (b)->tv_sec;			      \
-    (result)->tv_nsec = (a)->tv_nsec + (b)->tv_nsec;			      \
-    if ((result)->tv_nsec >= 1000000000)       				      \
-      {									      \
-	++(result)->tv_sec;						      \
-	(result)->tv_nsec -= 1000000000;	       			      \
-      }									      \
-  } while (0)
-# define timespecsub(a, b, result)     					      \
-  do {									      \
-    (result)->tv_sec = (a)->tv_sec - (b)->tv_sec;			      \
-    (result)->tv_nsec = (a)->tv_nsec - (b)->tv_nsec;			      \
-    if ((result)->tv_nsec < 0) {					      \
-      --(result)->tv_sec;						      \
-      (result)->tv_nsec += 1000000000;					      \
-    }									      \
-  } while (0)
+#include "nstime.h"
+#include "tscclock.h"
 
-#endif
+class EventLoop;
 
 class RTClock {
 public:
@@ -82,7 +62,7 @@ public:
   /**
    * Synchronize with other running clock
    */
-  void sync (RTClock& clock);
+  void sync (const RTClock& clock);
   
   /**
    * Reset time and stop clock.
@@ -113,39 +93,210 @@ public:
    */
   double time () const;
 
-  void getTime (struct timespec *t);
+  /**
+   * What setNextTarget () does when the new target has already
+   * passed because the last tick overran.  OVERRUN_BURST keeps the
+   * grid, so ticks follow back to back until they have caught up.
+   * OVERRUN_SKIP drops the grid points which have passed, and
+   * OVERRUN_STRETCH restarts the grid now.  Both of the latter hold
+   * back time () by the time given up, so that clock time keeps
+   * following the ticks, unless the clock is synchronized with an
+   * external clock.
+   */
+  enum OverrunPolicy { OVERRUN_BURST, OVERRUN_SKIP, OVERRUN_STRETCH };
+
+  /**
+   * An overrun: the clock time at which it was detected and how far
+   * behind the grid the clock was
+   */
+  struct Overrun {
+    NsTime time;
+    NsTime amount;
+  };
+
+#ifdef CLOCK_GETTIME
+
+  /**
+   * Return the absolute (monotonic) time now.
+   */
+  static NsTime getTime ();
+
+  /**
+   * Select the source of getTime (): "monotonic" (clock_gettime) or
+   * "tsc" (TscClock).  Return false if the TSC can't be used, in
+   * which case the monotonic clock is used.
+   */
+  static bool setSource (const std::string& source);
+
+  /**
+   * Return the name of the clock source in use.
+   */
+  static const char* source ();
+
+  /**
+   * Convert the absolute time now to time since starting time
+   */
+  NsTime relativeTime (NsTime now) const { return now - start_; }
+
+  /**
+   * Convert a time t since starting time to absolute time
+   */
+  NsTime absoluteTime (NsTime t) const { return t + start_; }
 
   /**
    * Set time.
    */
   void set (double time);
 
+  /**
+   * Set time such that it was time at the absolute time now.
+   */
+  void setAt (NsTime time, NsTime now);
+
+  /**
+   * Advance time by dt (which may be negative).
+   *
+   * Unlike set (), this also moves the target time, so that the
+   * target stays at the same clock time.
+   */
+  void slew (NsTime dt);
+
   /**
    * Set next target time to the current plus interval.
+   *
+   * If that time has already passed, count an overrun and apply the
+   * overrun policy.
    */
   void setNextTarget ();
 
   /**
-   * Return true if argument is less than current time
+   * Parse burst, skip or stretch into policy.  Return false if name
+   * is none of these.
+   */
+  static bool parseOverrunPolicy (const std::string& name,
+				  OverrunPolicy& policy);
+
+  void setOverrunPolicy (OverrunPolicy policy) { overrunPolicy_ = policy; }
+  OverrunPolicy overrunPolicy () const { return overrunPolicy_; }
+
+  /**
+   * Declare that time () is set from an external clock with setAt ()
+   * and slew ().  OVERRUN_SKIP and OVERRUN_STRETCH then move only the
+   * tick grid and leave time () to the external clock.
+   */
+  void setSynchronized (bool synchronized) { synchronized_ = synchronized; }
+
+  /**
+   * Return the number of overruns.  A burst of catch-up ticks counts
+   * as one.
+   */
+  unsigned long nOverruns () const { return nOverruns_; }
+
+  /**
+   * Return the number of grid points dropped by OVERRUN_SKIP.
+   */
+  unsigned long nSkipped () const { return nSkipped_; }
+
+  /**
+   * Return the total time by which skipping or stretching has held
+   * back time ().
+   */
+  NsTime heldBack () const { return heldBack_; }
+
+  /**
+   * Return the largest overruns, largest first.
+   */
+  const std::vector<Overrun>& worstOverruns () const { return worst_; }
+
+  /**
+   * Write the number of overruns and the worst of them
+   */
+  void overrunSummary (std::ostream& out, const std::string& prefix) const;
+
+  /**
+   * Return true if time t since starting time is at or before the
+   * absolute time now
    */
-  bool lessThanEql (const struct timespec* now, const struct timespec* t);
+  bool lessThanEql (NsTime t, NsTime now) const
+  {
+    return t + start_ <= now;
+  }
   
   /**
-   * Return true if argument is less than target time
+   * Return true if time t since starting time is before target time
    */
-  bool lessThanTarget (const struct timespec* t);
+  bool lessThanTarget (NsTime t) const { return t + start_ < gridtime_; }
   
   /**
    * Check if we have reached target time.
    */
-  bool pastTarget ();
+  bool pastTarget () const { return getTime () >= gridtime_; }
 
   /**
-   * Check if we have reached target time.
+   * Check if the absolute time now has reached target time.
    */
-  bool pastTarget (struct timespec &now);
+  bool pastTarget (NsTime now) const { return now >= gridtime_; }
 
-#ifndef CLOCK_GETTIME
+  /**
+   * Set the margin before a deadline where waitUntil () stops
+   * sleeping and starts to spin.  With a negative margin,
+   * waitUntil () never sleeps.
+   */
+  void setSpinMargin (double margin);
+
+  /**
+   * Wait until absolute time deadline.
+   *
+   * Sleep until spin margin before the deadline, then spin.
+   */
+  void waitUntil (NsTime deadline);
+
+  /**
+   * Wait like waitUntil (deadline), but sleep on loop.  Return false
+   * if a notification or a shutdown signal ended the wait early.
+   */
+  bool waitUntil (NsTime deadline, EventLoop& loop);
+
+  /**
+   * Wait until target time.
+   */
+  void waitForTarget () { waitUntil (gridtime_); }
+  bool waitForTarget (EventLoop& loop) { return waitUntil (gridtime_, loop); }
+
+  /**
+   * Return the tick interval.
+   */
+  double interval () const { return interval_.seconds (); }
+  NsTime intervalNs () const { return interval_; }
+
+  /**
+   * Return the absolute target time.
+   */
+  NsTime target () const { return gridtime_; }
+
+  /**
+   * Return the number of calls to waitUntil () which had to wait.
+   */
+  unsigned long nWaits () const { return nWaits_; }
+
+  /**
+   * Return mean and maximal time in seconds by which waitUntil ()
+   * returned after its deadline.
+   */
+  double meanLateness () const;
+  double maxLateness () const { return maxLateness_.seconds (); }
+
+  /**
+   * Return the CPU time in seconds used by this process.
+   */
+  static double cpuTime ();
+
+  /**
+   * Write one line describing the clock source
+   */
+  static void sourceSummary (std::ostream& out, const std::string& prefix);
+
+#else /* !CLOCK_GETTIME */
 
   /**
    * Sleep t seconds.
@@ -181,18 +332,12 @@ public:
    */
   struct timespec timespecFromTimeval (const struct timeval& tv) const;
 
-#endif /* !CLOCK_GETTIME */
-  
   /**
    * Convert a (relative) time t in seconds to a timespec
    */
   static struct timespec timespecFromSeconds (double s);
 
-#ifdef CLOCK_GETTIME
-
-  static inline double secondsFromTimespec (const struct timespec& tv);
-  
-#endif /* CLOCK_GETTIME */
+#endif /* !CLOCK_GETTIME */
   
 private:
 #ifndef CLOCK_GETTIME
@@ -200,12 +345,26 @@ private:
   struct timeval gridtime_;
   struct timeval interval_;
 #else
-public:
-  struct timespec start_;
-  struct timespec offset_; // 
-  struct timespec gridtime_;
-  struct timespec interval_;
+  NsTime start_;		// absolute time of time 0
+  NsTime gridtime_;		// absolute target time
+  NsTime interval_;
 #endif
+  bool spin_;			// never sleep in waitUntil ()
+  NsTime spinMargin_;
+  unsigned long nWaits_;
+  NsTime totalLateness_;
+  NsTime maxLateness_;
+  OverrunPolicy overrunPolicy_;
+  bool synchronized_;		// time () follows an external clock
+  bool behind_;			// catching up after an overrun
+  unsigned long nOverruns_;
+  unsigned long nSkipped_;
+  NsTime heldBack_;
+  std::vector<Overrun> worst_;	// sorted, largest first
+
+  void holdBack (NsTime dt);
+  void noteOverrun (NsTime time, NsTime amount);
+  void noteWait (NsTime lateness);
 };
 
 #ifndef CLOCK_GETTIME
@@ -242,8 +401,6 @@ RTClock::timespecFromTimeval (const struct timeval& tv) const
   ts.tv_nsec = 1000 * tv.tv_usec;
 }
 
-#endif /* !CLOCK_GETTIME */
-
 inline struct timespec
 RTClock::timespecFromSeconds (double t)
 {
@@ -253,69 +410,30 @@ RTClock::timespecFromSeconds (double t)
   return ts;
 }
 
-#ifdef CLOCK_GETTIME
+#else /* CLOCK_GETTIME */
 
-inline double
-RTClock::time () const
+inline NsTime
+RTClock::getTime ()
 {
+  if (TscClock::enabled ())
+    return TscClock::now ();
   struct timespec now;
   if (clock_gettime (CLOCK_MONOTONIC, &now) != 0)
     throw std::runtime_error (std::string ("gettime() failed: ")
 			      + strerror (errno));
-  timespecsub (&now, &start_, &now);
-  return secondsFromTimespec (now);
-}
-
-inline void
-RTClock::getTime (struct timespec *t)
-{
-  if (clock_gettime (CLOCK_MONOTONIC, t) != 0)
-    throw std::runtime_error (std::string ("gettime() failed: ")
-			      + strerror (errno));  
-}
-
-inline void
-RTClock::setNextTarget ()
-{
-  timespecadd (&gridtime_, &interval_, &gridtime_);
-}
-
-inline bool
-RTClock::lessThanEql (const struct timespec* t, const struct timespec* now)
-{
-  struct timespec absoluteT;
-  timespecadd (t, &start_, &absoluteT);
-  return timespeccmp (&absoluteT, now, <=);
+  return TscClock::clamp (NsTime::fromTimespec (now));
 }
 
-inline bool
-RTClock::lessThanTarget (const struct timespec* t)
-{
-  struct timespec absoluteT;
-  timespecadd (t, &start_, &absoluteT);
-  return timespeccmp (&absoluteT, &gridtime_, <);
-}
-
-inline bool
-RTClock::pastTarget ()
-{
-  struct timespec now;
-  if (clock_gettime (CLOCK_MONOTONIC, &now) != 0)
-    throw std::runtime_error (std::string ("gettime() failed: ")
-			      + strerror (errno));  
-  return timespeccmp (&now, &gridtime_, >=);
-}
-
-inline bool
-RTClock::pastTarget (struct timespec &now)
+inline double
+RTClock::time () const
 {
-  return timespeccmp (&now, &gridtime_, >=);
+  return (getTime () - start_).seconds ();
 }
 
 inline double
-RTClock::secondsFromTimespec (const struct timespec& tv)
+RTClock::meanLateness () const
 {
-  return tv.tv_sec + 1e-9 * tv.tv_nsec;
+  return nWaits_ > 0 ? totalLateness_.seconds () / nWaits_ : 0.0;
 }
 
 #endif /* CLOCK_GETTIME */
@@ -0,0 +1,370 @@
+/*
+ *  spinnmusic_bridge.cpp
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <mpi.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+}
+
+#include <music.hh>
+
+#include "MusicBridge.h"
+
+using namespace MUSIC;
+
+const double DEFAULT_TIMESTEP = 1e-2;
+const double DEFAULT_MARGIN = 1e-4;
+#ifdef RTCLOCK_TSC_DEFAULT
+const char* const DEFAULT_CLOCK = "tsc";
+#else
+const char* const DEFAULT_CLOCK = "monotonic";
+#endif
+const int DEFAULT_SYNC_WINDOW = 256;
+
+void
+usage (int rank)
+{
+  if (rank == 0)
+    {
+      std::cerr << "Usage: spinnmusic-bridge [OPTION...]\n"
+		<< "`spinnmusic_bridge' relays spikes from SpiNNaker to MUSIC output ports and\n"
+		<< "from MUSIC input ports to SpiNNaker, with one MUSIC tick for both.\n\n"
+		<< "  -i, --from LABEL:N[:PORTNAME]\n"
+		<< "                          relay population LABEL of size N from SpiNNaker\n"
+		<< "                          through output port PORTNAME (default LABEL);\n"
+		<< "                          may be repeated\n"
+		<< "  -o, --to LABEL:N[:PORTNAME]\n"
+		<< "                          relay spikes from input port PORTNAME (default\n"
+		<< "                          LABEL) to population LABEL of size N; may be repeated\n"
+		<< "  -p, --port N            database notification port (rank R uses N + R)\n"
+		<< "  -t, --timestep TIMESTEP time between tick() calls (default " << DEFAULT_TIMESTEP << " s)\n"
+		<< "  -d, --delay DELAY       add DELAY to the times of spikes sent to SpiNNaker\n"
+		<< "  -D, --from-delay DELAY  add DELAY to the times of spikes from SpiNNaker\n"
+		<< "  -b, --maxbuffered TICKS maximal amount of data buffered\n"
+		<< "  -a, --adapter           play well with Weidel and Hoff's music-adapters\n"
+		<< "  -m, --margin TIME       sleep until TIME s before deadlines, then spin\n"
+		<< "                          (default " << DEFAULT_MARGIN << " s, negative: always spin)\n"
+		<< "  -w, --syncwindow N      fit SpiNNaker clock over the last N timesteps\n"
+		<< "                          (default " << DEFAULT_SYNC_WINDOW << ", 0: set clock at every timestep)\n"
+		<< "  -S, --syncstats FILE    write clock synchronization statistics to FILE\n"
+		<< "  -R, --reorder N         hold spikes up to N timesteps to restore time order\n"
+		<< "  -L, --late POLICY       spikes too late for MUSIC: count (default, pass on),\n"
+		<< "                          drop, or clamp (to the earliest legal time)\n"
+		<< "  -q, --queue TYPE        spike queue: wheel (default) or heap\n"
+		<< "  -B, --batch N           send due spikes in batches of at most N\n"
+		<< "                          (default: one packet per spike)\n"
+		<< "  -H, --hold TIME         hold back a partial batch at most TIME s (default 0)\n"
+		<< "  -O, --overrun POLICY    when a tick overruns: burst (catch up, default), skip\n"
+		<< "                          (drop the missed ticks) or stretch (restart the grid)\n"
+		<< "  -T, --latency FILE      write latency histograms to FILE.in and FILE.out at\n"
+		<< "                          exit and on SIGUSR1\n"
+		<< "  -x, --pin THREAD:CPU[:PRIORITY]\n"
+		<< "                          run THREAD (tick, receive or send) on CPU, under\n"
+		<< "                          SCHED_FIFO with PRIORITY if given; may be repeated\n"
+		<< "  -M, --mlock             lock all memory and pre-allocate spike buffers\n"
+		<< "  -Z, --segments          after SpiNNaker pauses or stops, wait for the next\n"
+		<< "                          run () instead of ending (end at stoptime or SIGTERM)\n"
+		<< "  -c, --clock SOURCE      time source: monotonic or tsc (default " << DEFAULT_CLOCK << ")\n"
+		<< "  -h, --help              print this help message\n";
+    }
+  exit (1);
+}
+
+PopulationSpecs fromPopulations;
+PopulationSpecs toPopulations;
+int dbNotificationPort = 19999;
+double timestep = DEFAULT_TIMESTEP;
+double delay = 0.0;
+double fromDelay = 0.0;
+int    maxbuffered = 0;
+bool useBarrier = false;
+double spinMargin = DEFAULT_MARGIN;
+string latencyFile;
+string clockSource (DEFAULT_CLOCK);
+int syncWindow = DEFAULT_SYNC_WINDOW;
+string syncStatsFile;
+int reorderWindow = 0;
+string latePolicy ("count");
+string queueType ("wheel");
+int    maxBatch = 0;
+double holdTime = 0.0;
+string overrunPolicy ("burst");
+ThreadPlacements placements;
+bool lockPages = false;
+bool segments = false;
+
+
+void
+getargs (int rank, int argc, char* argv[])
+{
+  opterr = 0; // handle errors ourselves
+  while (1)
+    {
+      static struct option longOptions[] =
+	{
+	  {"from",        required_argument, 0, 'i'},
+	  {"to",          required_argument, 0, 'o'},
+	  {"port",        required_argument, 0, 'p'},
+	  {"timestep",    required_argument, 0, 't'},
+	  {"delay",       required_argument, 0, 'd'},
+	  {"from-delay",  required_argument, 0, 'D'},
+	  {"maxbuffered", required_argument, 0, 'b'},
+	  {"margin",      required_argument, 0, 'm'},
+	  {"syncwindow",  required_argument, 0, 'w'},
+	  {"syncstats",   required_argument, 0, 'S'},
+	  {"reorder",     required_argument, 0, 'R'},
+	  {"late",        required_argument, 0, 'L'},
+	  {"queue",       required_argument, 0, 'q'},
+	  {"batch",       required_argument, 0, 'B'},
+	  {"hold",        required_argument, 0, 'H'},
+	  {"overrun",     required_argument, 0, 'O'},
+	  {"latency",     required_argument, 0, 'T'},
+	  {"pin",         required_argument, 0, 'x'},
+	  {"mlock",       no_argument,       0, 'M'},
+	  {"segments",    no_argument,       0, 'Z'},
+	  {"clock",       required_argument, 0, 'c'},
+	  {"help",        no_argument,       0, 'h'},
+	  {"adapter",	  no_argument,       0, 'a'},
+	  {0, 0, 0, 0}
+	};
+      /* `getopt_long' stores the option index here. */
+      int option_index = 0;
+
+      // the + below tells getopt_long not to reorder argv
+      int c = getopt_long (argc, argv, "+i:o:p:t:d:D:b:am:w:S:R:L:q:B:H:O:T:x:Mc:hZ",
+			   longOptions, &option_index);
+
+      /* detect the end of the options */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'i':
+	case 'o':
+	  {
+	    PopulationSpec spec;
+	    if (!parsePopulation (optarg, spec))
+	      usage (rank);
+	    (c == 'i' ? fromPopulations : toPopulations).push_back (spec);
+	  }
+	  continue;
+	case 'p':
+	  dbNotificationPort = atoi (optarg);
+	  continue;
+	case 't':
+	  timestep = atof (optarg); // NOTE: could do error checking
+	  continue;
+	case 'd':
+	  delay = atof (optarg); // NOTE: could do error checking
+	  continue;
+	case 'D':
+	  fromDelay = atof (optarg);
+	  continue;
+	case 'b':
+	  maxbuffered = atoi (optarg);
+	  continue;
+	case 'a':
+	  useBarrier = true;
+	  continue;
+	case 'm':
+	  spinMargin = atof (optarg);
+	  continue;
+	case 'w':
+	  syncWindow = atoi (optarg);
+	  if (syncWindow < 0)
+	    usage (rank);
+	  continue;
+	case 'S':
+	  syncStatsFile = optarg;
+	  continue;
+	case 'R':
+	  reorderWindow = atoi (optarg);
+	  continue;
+	case 'L':
+	  latePolicy = optarg;
+	  if (latePolicy != "count" && latePolicy != "drop" && latePolicy != "clamp")
+	    usage (rank);
+	  continue;
+	case 'q':
+	  queueType = optarg;
+	  if (queueType != "wheel" && queueType != "heap")
+	    usage (rank);
+	  continue;
+	case 'B':
+	  maxBatch = atoi (optarg);
+	  continue;
+	case 'H':
+	  holdTime = atof (optarg);
+	  continue;
+	case 'O':
+	  {
+	    RTClock::OverrunPolicy policy;
+	    overrunPolicy = optarg;
+	    if (!RTClock::parseOverrunPolicy (overrunPolicy, policy))
+	      usage (rank);
+	  }
+	  continue;
+	case 'T':
+	  latencyFile = optarg;
+	  continue;
+	case 'x':
+	  {
+	    ThreadPlacement placement;
+	    if (!parsePlacement (optarg, placement))
+	      usage (rank);
+	    placements.push_back (placement);
+	  }
+	  continue;
+	case 'M':
+	  lockPages = true;
+	  continue;
+	case 'Z':
+	  segments = true;
+	  continue;
+	case 'c':
+	  clockSource = optarg;
+	  if (clockSource != "monotonic" && clockSource != "tsc")
+	    usage (rank);
+	  continue;
+	case '?':
+	  break; // ignore unknown options
+	case 'h':
+	  usage (rank);
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc < optind + 0 || argc > optind + 0)
+    usage (rank);
+
+  // The clock follows the spikes from SpiNNaker, and start and stop
+  // are heard on one of them
+  if (fromPopulations.empty () || toPopulations.empty ())
+    usage (rank);
+}
+
+
+int
+main (int argc, char* argv[])
+{
+  // SIGINT and SIGTERM end the main loop cleanly, also when they
+  // arrive at the threads of MPI or the SpiNNaker connection
+  EventLoop::blockShutdownSignals ();
+
+  Setup* setup = new Setup (argc, argv);
+  Runtime* runtime;
+
+  MPI::Intracomm comm = setup->communicator ();
+  int rank = comm.Get_rank ();
+  getargs (rank, argc, argv);
+
+  if (!RTClock::setSource (clockSource) && rank == 0)
+    std::cerr << "MB: TSC clock not available, using CLOCK_MONOTONIC\n";
+
+  LatencyHistogram::dumpOnSignal (SIGUSR1);
+
+  double stoptime;
+  setup->config ("stoptime", &stoptime);
+
+  std::vector<char*> receive_labels;
+  for (size_t i = 0; i < fromPopulations.size (); ++i)
+    receive_labels.push_back ((char*) fromPopulations[i].label.c_str ());
+  std::vector<char*> send_labels;
+  for (size_t i = 0; i < toPopulations.size (); ++i)
+    send_labels.push_back ((char*) toPopulations[i].label.c_str ());
+  char const* local_host = NULL;
+  SpynnakerLiveSpikesConnection* connection =
+    new SpynnakerLiveSpikesConnection(receive_labels.size (),
+				      &receive_labels[0],
+				      send_labels.size (),
+				      &send_labels[0],
+				      (char*) local_host,
+				      dbNotificationPort + rank);
+
+  // Both adapters publish their ports before the one Runtime is
+  // created
+  string inLatency = latencyFile.empty () ? "" : latencyFile + ".in";
+  string outLatency = latencyFile.empty () ? "" : latencyFile + ".out";
+  MusicOutputAdapter musicOutput (setup, runtime, timestep, fromDelay, stoptime,
+				  fromPopulations,
+				  false,	// barrier, done below
+				  spinMargin, syncWindow, syncStatsFile,
+				  reorderWindow, latePolicy, inLatency,
+				  "",		// no recording
+				  0.0, 1,	// no rates
+				  true,		// events
+				  overrunPolicy, placements, lockPages,
+				  false);	// the Runtime is created below
+  // The input adapter runs on the clock of the output adapter, so
+  // overrunPolicy applies to it through that clock
+  MusicInputAdapter musicInput (setup, runtime, timestep, delay, maxbuffered,
+				stoptime, toPopulations,
+				false,		// barrier, done below
+				0.0,		// no sync protocol
+				queueType, maxBatch, holdTime, spinMargin,
+				outLatency,
+				"", 0,		// no spike generation
+				true,		// events
+				"burst",	// unused, see above
+				0.0,		// no sync protocol
+				placements, lockPages,
+				false);		// the Runtime is created below
+  if (useBarrier)
+    MPI::COMM_WORLD.Barrier();
+  runtime = new Runtime (setup, timestep);
+  musicOutput.attach (runtime);
+  musicInput.attach (runtime);
+  musicInput.setConnection (connection);
+
+  MusicBridge bridge (runtime, musicOutput, musicInput, stoptime,
+		      placements, lockPages);
+
+  // Start and stop concern the whole simulation, so listen for them
+  // on one label only
+  connection->add_start_callback (receive_labels[0], &bridge);
+  connection->add_pause_stop_callback (receive_labels[0], &bridge);
+  for (size_t i = 0; i < receive_labels.size (); ++i)
+    connection->add_receive_callback (receive_labels[i], &musicOutput);
+
+  bridge.setSegments (segments);
+  bridge.main_loop ();
+
+  // Shut the connection down before its callbacks go away
+  delete connection;
+
+  runtime->finalize ();
+  delete runtime;
+
+  return 0;
+}
@@ -1,7 +1,7 @@
 /*
  *  spinnmusic_out.cpp
  *
- *  Copyright (C) 2017, 2018, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -18,12 +18,18 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <mpi.h>
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 extern "C" {
+#include <signal.h>
 #include <unistd.h>
 #include <getopt.h>
 }
@@ -35,6 +41,13 @@ extern "C" {
 using namespace MUSIC;
 
 const double DEFAULT_TIMESTEP = 1e-2;
+const double DEFAULT_MARGIN = 1e-4;
+#ifdef RTCLOCK_TSC_DEFAULT
+const char* const DEFAULT_CLOCK = "tsc";
+#else
+const char* const DEFAULT_CLOCK = "monotonic";
+#endif
+const int DEFAULT_SYNC_WINDOW = 256;
 
 void
 usage (int rank)
@@ -46,18 +59,49 @@ usage (int rank)
 		<< "hardware and relays them through a MUSIC port.\n\n"
 		<< "  -l, --label LABEL       population label\n"
 		<< "  -r, --range N           population size\n"
+		<< "  -P, --population LABEL:N[:PORTNAME]\n"
+		<< "                          relay population LABEL of size N through port\n"
+		<< "                          PORTNAME (default LABEL); may be repeated\n"
 		<< "  -o, --out PORTNAME      output port name (default: out)\n"
-		<< "  -p, --port N            database notification port\n"
+		<< "  -p, --port N            database notification port (rank R uses N + R)\n"
 		<< "  -t, --timestep TIMESTEP time between tick() calls (default " << DEFAULT_TIMESTEP << " s)\n"
 		<< "  -d, --delay DELAY       add DELAY to spike times\n"
 		<< "  -b, --maxbuffered TICKS maximal amount of data buffered\n"
 		<< "  -a, --adapter           play well with Weidel and Hoff's music-adapters\n"
+		<< "  -m, --margin TIME       sleep until TIME s before deadlines, then spin\n"
+		<< "                          (default " << DEFAULT_MARGIN << " s, negative: always spin)\n"
+		<< "  -w, --syncwindow N      fit SpiNNaker clock over the last N timesteps\n"
+		<< "                          (default " << DEFAULT_SYNC_WINDOW << ", 0: set clock at every timestep)\n"
+		<< "  -S, --syncstats FILE    write clock synchronization statistics to FILE\n"
+		<< "  -R, --reorder N         hold spikes up to N timesteps to restore time order\n"
+		<< "  -L, --late POLICY       spikes too late for MUSIC: count (default, pass on),\n"
+		<< "                          drop, or clamp (to the earliest legal time)\n"
+		<< "  -O, --overrun POLICY    when a tick overruns: burst (catch up, default), skip\n"
+		<< "                          (drop the missed ticks) or stretch (restart the grid)\n"
+		<< "  -T, --latency FILE      write latency histograms to FILE at exit and on SIGUSR1\n"
+		<< "  -f, --record FILE       write received spikes to the binary spike log FILE\n"
+		<< "                          (FILE.R on rank R if there are several ranks)\n"
+		<< "  -C, --rates WINDOW      also relay firing rates over the last WINDOW s through\n"
+		<< "                          continuous port PORTNAME_rate\n"
+		<< "  -G, --group N           relay the mean rate of groups of N neurons (default 1)\n"
+		<< "  -E, --no-events         relay only rates, no spike events\n"
+		<< "  -y, --replay FILE       relay spikes from a spike log or TIME ID text file\n"
+		<< "                          at their recorded times instead of from SpiNNaker\n"
+		<< "  -F, --fast              replay as fast as possible\n"
+		<< "  -x, --pin THREAD:CPU[:PRIORITY]\n"
+		<< "                          run THREAD (tick or receive) on CPU, under SCHED_FIFO\n"
+		<< "                          with PRIORITY if given; may be repeated\n"
+		<< "  -M, --mlock             lock all memory and pre-allocate spike buffers\n"
+		<< "  -Z, --segments          after SpiNNaker pauses or stops, wait for the next\n"
+		<< "                          run () instead of ending (end at stoptime or SIGTERM)\n"
+		<< "  -c, --clock SOURCE      time source: monotonic or tsc (default " << DEFAULT_CLOCK << ")\n"
 		<< "  -h, --help              print this help message\n";
     }
   exit (1);
 }
 
 string label;
+PopulationSpecs populations;
 string portName ("out");
 int dbNotificationPort = 19999;
 int    nUnits;
@@ -65,6 +109,23 @@ double timestep = DEFAULT_TIMESTEP;
 double delay = 0.0;
 int    maxbuffered = 1;
 bool useBarrier = false;
+double spinMargin = DEFAULT_MARGIN;
+string latencyFile;
+string clockSource (DEFAULT_CLOCK);
+string recordFile;
+string replayFile;
+double rateWindow = 0.0;
+int groupSize = 1;
+bool events = true;
+bool fastReplay = false;
+int syncWindow = DEFAULT_SYNC_WINDOW;
+string syncStatsFile;
+int reorderWindow = 0;
+string latePolicy ("count");
+string overrunPolicy ("burst");
+ThreadPlacements placements;
+bool lockPages = false;
+bool segments = false;
 
 
 void
@@ -77,10 +138,28 @@ getargs (int rank, int argc, char* argv[])
 	{
 	  {"label",       required_argument, 0, 'l'},
 	  {"range",       required_argument, 0, 'r'},
+	  {"population",  required_argument, 0, 'P'},
 	  {"port",        required_argument, 0, 'p'},
 	  {"timestep",    required_argument, 0, 't'},
 	  {"delay",       required_argument, 0, 'd'},
 	  {"maxbuffered", required_argument, 0, 'b'},
+	  {"margin",      required_argument, 0, 'm'},
+	  {"latency",     required_argument, 0, 'T'},
+	  {"clock",       required_argument, 0, 'c'},
+	  {"record",      required_argument, 0, 'f'},
+	  {"replay",      required_argument, 0, 'y'},
+	  {"rates",       required_argument, 0, 'C'},
+	  {"group",       required_argument, 0, 'G'},
+	  {"no-events",   no_argument,       0, 'E'},
+	  {"fast",        no_argument,       0, 'F'},
+	  {"syncwindow",  required_argument, 0, 'w'},
+	  {"syncstats",   required_argument, 0, 'S'},
+	  {"reorder",     required_argument, 0, 'R'},
+	  {"late",        required_argument, 0, 'L'},
+	  {"overrun",     required_argument, 0, 'O'},
+	  {"pin",         required_argument, 0, 'x'},
+	  {"mlock",       no_argument,       0, 'M'},
+	  {"segments",    no_argument,       0, 'Z'},
 	  {"help",        no_argument,       0, 'h'},
 	  {"out",	  required_argument, 0, 'o'},
 	  {"adapter",	  no_argument,       0, 'a'},
@@ -90,7 +169,7 @@ getargs (int rank, int argc, char* argv[])
       int option_index = 0;
 
       // the + below tells getopt_long not to reorder argv
-      int c = getopt_long (argc, argv, "+l:r:t:d:b:ho:a",
+      int c = getopt_long (argc, argv, "+l:r:P:t:d:b:ho:am:w:S:R:L:O:x:MT:c:f:y:FC:G:EZ",
 			   longOptions, &option_index);
 
       /* detect the end of the options */
@@ -105,6 +184,14 @@ getargs (int rank, int argc, char* argv[])
 	case 'r':
 	  nUnits = atoi (optarg);
 	  continue;
+	case 'P':
+	  {
+	    PopulationSpec spec;
+	    if (!parsePopulation (optarg, spec))
+	      usage (rank);
+	    populations.push_back (spec);
+	  }
+	  continue;
 	case 't':
 	  timestep = atof (optarg); // NOTE: could do error checking
 	  continue;
@@ -123,6 +210,77 @@ getargs (int rank, int argc, char* argv[])
 	case 'p':
 	  dbNotificationPort = atoi (optarg);
 	  continue;
+	case 'm':
+	  spinMargin = atof (optarg);
+	  continue;
+	case 'T':
+	  latencyFile = optarg;
+	  continue;
+	case 'f':
+	  recordFile = optarg;
+	  continue;
+	case 'y':
+	  replayFile = optarg;
+	  continue;
+	case 'F':
+	  fastReplay = true;
+	  continue;
+	case 'C':
+	  rateWindow = atof (optarg);
+	  if (rateWindow <= 0.0)
+	    usage (rank);
+	  continue;
+	case 'G':
+	  groupSize = atoi (optarg);
+	  if (groupSize <= 0)
+	    usage (rank);
+	  continue;
+	case 'E':
+	  events = false;
+	  continue;
+	case 'c':
+	  clockSource = optarg;
+	  if (clockSource != "monotonic" && clockSource != "tsc")
+	    usage (rank);
+	  continue;
+	case 'w':
+	  syncWindow = atoi (optarg);
+	  if (syncWindow < 0)
+	    usage (rank);
+	  continue;
+	case 'S':
+	  syncStatsFile = optarg;
+	  continue;
+	case 'R':
+	  reorderWindow = atoi (optarg);
+	  continue;
+	case 'L':
+	  latePolicy = optarg;
+	  if (latePolicy != "count" && latePolicy != "drop" && latePolicy != "clamp")
+	    usage (rank);
+	  continue;
+	case 'x':
+	  {
+	    ThreadPlacement placement;
+	    if (!parsePlacement (optarg, placement))
+	      usage (rank);
+	    placements.push_back (placement);
+	  }
+	  continue;
+	case 'M':
+	  lockPages = true;
+	  continue;
+	case 'Z':
+	  segments = true;
+	  continue;
+	case 'O':
+	  {
+	    RTClock::OverrunPolicy policy;
+	    overrunPolicy = optarg;
+	    if (!RTClock::parseOverrunPolicy (overrunPolicy, policy))
+	      usage (rank);
+	  }
+	  continue;
 	case '?':
 	  break; // ignore unknown options
 	case 'h':
@@ -135,12 +293,25 @@ getargs (int rank, int argc, char* argv[])
 
   if (argc < optind + 0 || argc > optind + 0)
     usage (rank);
+
+  if (!events && rateWindow <= 0.0)
+    usage (rank);
+
+  if (populations.empty ())
+    {
+      PopulationSpec spec = { label, nUnits, portName };
+      populations.push_back (spec);
+    }
 }
 
 
 int
 main (int argc, char* argv[])
 {
+  // SIGINT and SIGTERM end the main loop cleanly, also when they
+  // arrive at the threads of MPI or the SpiNNaker connection
+  EventLoop::blockShutdownSignals ();
+
   Setup* setup = new Setup (argc, argv);
   Runtime* runtime;
 
@@ -148,27 +319,53 @@ main (int argc, char* argv[])
   int rank = comm.Get_rank ();
   getargs (rank, argc, argv);
 
+  if (!RTClock::setSource (clockSource) && rank == 0)
+    std::cerr << "MI: TSC clock not available, using CLOCK_MONOTONIC\n";
+
+  LatencyHistogram::dumpOnSignal (SIGUSR1);
+
   double stoptime;
   setup->config ("stoptime", &stoptime); // add error handling
 
-  char* receive_labels[1] = { (char*) label.c_str () };
+  std::vector<char*> receive_labels;
+  for (size_t i = 0; i < populations.size (); ++i)
+    receive_labels.push_back ((char*) populations[i].label.c_str ());
   char const* local_host = NULL;
-  SpynnakerLiveSpikesConnection connection =
-    SpynnakerLiveSpikesConnection(1,
-				  receive_labels,
-				  0,
-				  NULL,
-				  (char*) local_host,
-				  dbNotificationPort);
+  SpynnakerLiveSpikesConnection* connection = NULL;
+  if (replayFile.empty ())
+    connection =
+      new SpynnakerLiveSpikesConnection(receive_labels.size (),
+					&receive_labels[0],
+					0,
+					NULL,
+					(char*) local_host,
+					dbNotificationPort + rank);
   
-  MusicOutputAdapter musicOutput (setup, runtime, timestep, delay, stoptime, label, nUnits, portName, useBarrier);
+  MusicOutputAdapter musicOutput (setup, runtime, timestep, delay, stoptime, populations, useBarrier, spinMargin, syncWindow, syncStatsFile, reorderWindow, latePolicy, latencyFile, recordFile, rateWindow, groupSize, events, overrunPolicy, placements, lockPages);
 
-  connection.add_start_callback ((char*) label.c_str (), &musicOutput);
-  connection.add_pause_stop_callback ((char*) label.c_str (), &musicOutput);
-  connection.add_receive_callback ((char*) label.c_str (), &musicOutput);
+  SpikeReplay* replay = NULL;
+  if (connection)
+    {
+      // Start and stop concern the whole simulation, so listen for them
+      // on one label only
+      connection->add_start_callback (receive_labels[0], &musicOutput);
+      connection->add_pause_stop_callback (receive_labels[0], &musicOutput);
+      for (size_t i = 0; i < receive_labels.size (); ++i)
+	connection->add_receive_callback (receive_labels[i], &musicOutput);
+    }
+  else
+    {
+      replay = new SpikeReplay (replayFile);
+      musicOutput.setReplay (replay, fastReplay);
+    }
 
+  musicOutput.setSegments (segments);
   musicOutput.main_loop ();
 
+  // Shut the connection down before its callbacks go away
+  delete connection;
+  delete replay;
+
   runtime->finalize ();
 
   return 0;
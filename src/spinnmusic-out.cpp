@@ -1,7 +1,7 @@
 /*
  *  spinnmusic_out.cpp
  *
- *  Copyright (C) 2017, 2018, 2019, 2021, 2022, 2023 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *  Copyright (C) 2017, 2018, 2019, 2021, 2022, 2023, 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
  *
  *  libneurosim is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -18,12 +18,18 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <mpi.h>
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 extern "C" {
+#include <signal.h>
 #include <unistd.h>
 #include <getopt.h>
 }
@@ -35,6 +41,12 @@ extern "C" {
 using namespace MUSIC;
 
 const double DEFAULT_TIMESTEP = 1e-2;
+const double DEFAULT_MARGIN = 1e-4;
+#ifdef RTCLOCK_TSC_DEFAULT
+const char* const DEFAULT_CLOCK = "tsc";
+#else
+const char* const DEFAULT_CLOCK = "monotonic";
+#endif
 
 void
 usage (int rank)
@@ -46,19 +58,46 @@ usage (int rank)
 		<< "hardware and relays them through a MUSIC port.\n\n"
 		<< "  -l, --label LABEL       population label\n"
 		<< "  -r, --range N           population size\n"
+		<< "  -P, --population LABEL:N[:PORTNAME]\n"
+		<< "                          relay population LABEL of size N through port\n"
+		<< "                          PORTNAME (default LABEL); may be repeated\n"
 		<< "  -o, --out PORTNAME      output port name (default: out)\n"
-		<< "  -p, --port N            database notification port\n"
+		<< "  -p, --port N            database notification port (rank R uses N + R)\n"
 		<< "  -t, --timestep TIMESTEP time between tick() calls (default " << DEFAULT_TIMESTEP << " s)\n"
 		<< "  -d, --delay DELAY       add DELAY to spike times\n"
 		<< "  -b, --maxbuffered TICKS maximal amount of data buffered\n"
 		<< "  -a, --adapter           play well with Weidel and Hoff's music-adapters\n"
 		<< "  -s, --sync INTERVAL     use SpiNNaker sync protocol\n"
+		<< "  -W, --settle TIME       with --sync, resume SpiNNaker at least TIME s after\n"
+		<< "                          the last spike of an interval (default 0)\n"
+		<< "  -q, --queue TYPE        spike queue: wheel (default) or heap\n"
+		<< "  -B, --batch N           send due spikes in batches of at most N\n"
+		<< "                          (default: one packet per spike)\n"
+		<< "  -H, --hold TIME         hold back a partial batch at most TIME s (default 0)\n"
+		<< "  -m, --margin TIME       sleep until TIME s before deadlines, then spin\n"
+		<< "                          (default " << DEFAULT_MARGIN << " s, negative: always spin)\n"
+		<< "  -T, --latency FILE      write latency histograms to FILE at exit and on SIGUSR1\n"
+		<< "  -g, --generate PATTERN  also receive rates through continuous port PORTNAME_rate\n"
+		<< "                          and send poisson or regular spike trains at those rates\n"
+		<< "  -k, --seed N            random seed for --generate (default 0)\n"
+		<< "  -E, --no-events         receive only rates, no spike events\n"
+		<< "  -y, --replay FILE       also send the spikes of a spike log or TIME ID text file\n"
+		<< "  -O, --overrun POLICY    when a tick overruns: burst (catch up, default), skip\n"
+		<< "                          (drop the missed ticks) or stretch (restart the grid)\n"
+		<< "  -x, --pin THREAD:CPU[:PRIORITY]\n"
+		<< "                          run THREAD (tick or send) on CPU, under SCHED_FIFO\n"
+		<< "                          with PRIORITY if given; may be repeated\n"
+		<< "  -M, --mlock             lock all memory and pre-allocate spike buffers\n"
+		<< "  -Z, --segments          after SpiNNaker pauses or stops, wait for the next\n"
+		<< "                          run () instead of ending (end at stoptime or SIGTERM)\n"
+		<< "  -c, --clock SOURCE      time source: monotonic or tsc (default " << DEFAULT_CLOCK << ")\n"
 		<< "  -h, --help              print this help message\n";
     }
   exit (1);
 }
 
 string label;
+PopulationSpecs populations;
 string portName ("in");
 int dbNotificationPort = 19999;
 int    nUnits;
@@ -66,7 +105,22 @@ double timestep = DEFAULT_TIMESTEP;
 double delay = 0.0;
 int    maxbuffered = 0;
 bool useBarrier = false;
+double spinMargin = DEFAULT_MARGIN;
+string latencyFile;
+string clockSource (DEFAULT_CLOCK);
+string replayFile;
+string generate;
+unsigned long seed = 0;
+bool events = true;
+string overrunPolicy ("burst");
+ThreadPlacements placements;
+bool lockPages = false;
+bool segments = false;
 double syncInterval = 0.0;
+double settle = 0.0;
+string queueType ("wheel");
+int    maxBatch = 0;
+double holdTime = 0.0;
 
 void
 getargs (int rank, int argc, char* argv[])
@@ -78,21 +132,37 @@ getargs (int rank, int argc, char* argv[])
 	{
 	  {"label",       required_argument, 0, 'l'},
 	  {"range",       required_argument, 0, 'r'},
+	  {"population",  required_argument, 0, 'P'},
 	  {"port",        required_argument, 0, 'p'},
 	  {"timestep",    required_argument, 0, 't'},
 	  {"delay",       required_argument, 0, 'd'},
 	  {"maxbuffered", required_argument, 0, 'b'},
+	  {"margin",      required_argument, 0, 'm'},
+	  {"latency",     required_argument, 0, 'T'},
+	  {"clock",       required_argument, 0, 'c'},
+	  {"replay",      required_argument, 0, 'y'},
+	  {"generate",    required_argument, 0, 'g'},
+	  {"seed",        required_argument, 0, 'k'},
+	  {"no-events",   no_argument,       0, 'E'},
+	  {"overrun",     required_argument, 0, 'O'},
+	  {"pin",         required_argument, 0, 'x'},
+	  {"mlock",       no_argument,       0, 'M'},
+	  {"segments",    no_argument,       0, 'Z'},
 	  {"help",        no_argument,       0, 'h'},
 	  {"out",	  required_argument, 0, 'o'},
 	  {"adapter",	  no_argument, 0, 'a'},
 	  {"sync",        required_argument, 0, 's'},
+	  {"settle",      required_argument, 0, 'W'},
+	  {"queue",       required_argument, 0, 'q'},
+	  {"batch",       required_argument, 0, 'B'},
+	  {"hold",        required_argument, 0, 'H'},
 	  {0, 0, 0, 0}
 	};
       /* `getopt_long' stores the option index here. */
       int option_index = 0;
 
       // the + below tells getopt_long not to reorder argv
-      int c = getopt_long (argc, argv, "+l:r:t:d:b:ho:as:",
+      int c = getopt_long (argc, argv, "+l:r:P:t:d:b:ho:as:W:q:B:H:m:T:c:y:g:k:EO:x:MZ",
 			   longOptions, &option_index);
 
       /* detect the end of the options */
@@ -107,6 +177,14 @@ getargs (int rank, int argc, char* argv[])
 	case 'r':
 	  nUnits = atoi (optarg);
 	  continue;
+	case 'P':
+	  {
+	    PopulationSpec spec;
+	    if (!parsePopulation (optarg, spec))
+	      usage (rank);
+	    populations.push_back (spec);
+	  }
+	  continue;
 	case 't':
 	  timestep = atof (optarg); // NOTE: could do error checking
 	  continue;
@@ -125,9 +203,73 @@ getargs (int rank, int argc, char* argv[])
 	case 's':
 	  syncInterval = atof (optarg);
 	  continue;
+	case 'W':
+	  settle = atof (optarg);
+	  continue;
+	case 'q':
+	  queueType = optarg;
+	  if (queueType != "wheel" && queueType != "heap")
+	    usage (rank);
+	  continue;
+	case 'B':
+	  maxBatch = atoi (optarg);
+	  continue;
+	case 'H':
+	  holdTime = atof (optarg);
+	  continue;
 	case 'p':
 	  dbNotificationPort = atoi (optarg);
 	  continue;
+	case 'm':
+	  spinMargin = atof (optarg);
+	  continue;
+	case 'T':
+	  latencyFile = optarg;
+	  continue;
+	case 'y':
+	  replayFile = optarg;
+	  continue;
+	case 'g':
+	  {
+	    SpikeGenerator::Pattern pattern;
+	    generate = optarg;
+	    if (!SpikeGenerator::parsePattern (generate, pattern))
+	      usage (rank);
+	  }
+	  continue;
+	case 'k':
+	  seed = strtoul (optarg, NULL, 0);
+	  continue;
+	case 'E':
+	  events = false;
+	  continue;
+	case 'x':
+	  {
+	    ThreadPlacement placement;
+	    if (!parsePlacement (optarg, placement))
+	      usage (rank);
+	    placements.push_back (placement);
+	  }
+	  continue;
+	case 'M':
+	  lockPages = true;
+	  continue;
+	case 'Z':
+	  segments = true;
+	  continue;
+	case 'O':
+	  {
+	    RTClock::OverrunPolicy policy;
+	    overrunPolicy = optarg;
+	    if (!RTClock::parseOverrunPolicy (overrunPolicy, policy))
+	      usage (rank);
+	  }
+	  continue;
+	case 'c':
+	  clockSource = optarg;
+	  if (clockSource != "monotonic" && clockSource != "tsc")
+	    usage (rank);
+	  continue;
 	case '?':
 	  break; // ignore unknown options
 	case 'h':
@@ -140,12 +282,25 @@ getargs (int rank, int argc, char* argv[])
 
   if (argc < optind + 0 || argc > optind + 0)
     usage (rank);
+
+  if (!events && generate.empty ())
+    usage (rank);
+
+  if (populations.empty ())
+    {
+      PopulationSpec spec = { label, nUnits, portName };
+      populations.push_back (spec);
+    }
 }
 
 
 int
 main (int argc, char* argv[])
 {
+  // SIGINT and SIGTERM end the main loop cleanly, also when they
+  // arrive at the threads of MPI or the SpiNNaker connection
+  EventLoop::blockShutdownSignals ();
+
   Setup* setup = new Setup (argc, argv);
   Runtime* runtime;
 
@@ -153,25 +308,44 @@ main (int argc, char* argv[])
   int rank = comm.Get_rank ();
   getargs (rank, argc, argv);
 
+  if (!RTClock::setSource (clockSource) && rank == 0)
+    std::cerr << "MO: TSC clock not available, using CLOCK_MONOTONIC\n";
+
+  LatencyHistogram::dumpOnSignal (SIGUSR1);
+
   double stoptime;
   setup->config ("stoptime", &stoptime);
 
-  char* send_labels[1] = { (char*) label.c_str () };
+  std::vector<char*> send_labels;
+  for (size_t i = 0; i < populations.size (); ++i)
+    send_labels.push_back ((char*) populations[i].label.c_str ());
   char const* local_host = NULL;
   SpynnakerLiveSpikesConnection connection =
     SpynnakerLiveSpikesConnection(0,
 				  NULL,
-				  1,
-				  send_labels,
+				  send_labels.size (),
+				  &send_labels[0],
 				  (char*) local_host,
-				  dbNotificationPort);
+				  dbNotificationPort + rank);
 
-  MusicInputAdapter* musicInput = new MusicInputAdapter (setup, runtime, timestep, delay, maxbuffered, stoptime, label, nUnits, portName, useBarrier, syncInterval);
+  MusicInputAdapter* musicInput = new MusicInputAdapter (setup, runtime, timestep, delay, maxbuffered, stoptime, populations, useBarrier, syncInterval, queueType, maxBatch, holdTime, spinMargin, latencyFile, generate, seed, events, overrunPolicy, settle, placements, lockPages);
 
-  connection.add_start_callback ((char*) label.c_str (), musicInput);
-  connection.add_pause_stop_callback ((char*) label.c_str (), musicInput);
+  SpikeReplay* replay = NULL;
+  if (!replayFile.empty ())
+    {
+      replay = new SpikeReplay (replayFile);
+      musicInput->setReplay (replay);
+    }
+
+  // Start and stop concern the whole simulation, so listen for them
+  // on one label only
+  connection.add_start_callback (send_labels[0], musicInput);
+  connection.add_pause_stop_callback (send_labels[0], musicInput);
 
+  musicInput->setSegments (segments);
   musicInput->main_loop ();
 
+  delete replay;
+
   return 0;
 }
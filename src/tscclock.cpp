@@ -0,0 +1,223 @@
+/*
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <time.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#if defined (__x86_64__) || defined (__i386__)
+#include <cpuid.h>
+#endif
+#include "tscclock.h"
+
+// Length of the initial calibration
+const NsTime CALIBRATION_TIME = NsTime (20000000);
+
+// Where the kernel lists the clock sources it still trusts
+const char* AVAILABLE_CLOCKSOURCES
+  = "/sys/devices/system/clocksource/clocksource0/available_clocksource";
+
+constexpr NsTime TscClock::CHECK_INTERVAL;
+constexpr NsTime TscClock::MAX_DEVIATION;
+
+std::atomic<bool> TscClock::enabled_ (false);
+std::atomic<bool> TscClock::checking_ (false);
+std::atomic<uint32_t> TscClock::seq_ (0);
+std::atomic<uint64_t> TscClock::baseTsc_ (0);
+std::atomic<int64_t> TscClock::baseNs_ (0);
+std::atomic<uint64_t> TscClock::mult_ (0);
+std::atomic<uint64_t> TscClock::checkAt_ (0);
+uint64_t TscClock::checkTicks_ = 0;
+uint64_t TscClock::originTsc_ = 0;
+int64_t TscClock::originNs_ = 0;
+double TscClock::nsPerTick_ = 0.0;
+std::atomic<int64_t> TscClock::maxDeviation_ (0);
+std::atomic<int64_t> TscClock::last_ (0);
+
+
+static NsTime
+monotonic ()
+{
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return NsTime::fromTimespec (t);
+}
+
+
+bool
+TscClock::usable ()
+{
+#if defined (__x86_64__) || defined (__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid (0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+  __get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx);
+  if (!(edx & (1 << 8)))	// invariant TSC
+    return false;
+  // The kernel drops the TSC from its clock sources if it finds it
+  // unreliable
+  std::ifstream sources (AVAILABLE_CLOCKSOURCES);
+  std::string source;
+  if (!sources)
+    return true;
+  while (sources >> source)
+    if (source == "tsc")
+      return true;
+  return false;
+#else
+  return false;
+#endif
+}
+
+
+// Read the TSC and CLOCK_MONOTONIC at (nearly) the same moment
+void
+TscClock::sample (uint64_t& tsc, NsTime& ns)
+{
+  NsTime before = monotonic ();
+  tsc = rdtsc ();
+  NsTime after = monotonic ();
+  ns = before + NsTime ((after - before).ns () / 2);
+}
+
+
+void
+TscClock::publish (uint64_t baseTsc, int64_t baseNs, double nsPerTick)
+{
+  uint32_t seq = seq_.load (std::memory_order_relaxed);
+  seq_.store (seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence (std::memory_order_release);
+  baseTsc_.store (baseTsc, std::memory_order_relaxed);
+  baseNs_.store (baseNs, std::memory_order_relaxed);
+  mult_.store ((uint64_t) (nsPerTick * (1ULL << SHIFT) + 0.5),
+	       std::memory_order_relaxed);
+  checkAt_.store (baseTsc + checkTicks_, std::memory_order_relaxed);
+  seq_.store (seq + 2, std::memory_order_release);
+}
+
+
+bool
+TscClock::enable ()
+{
+  if (enabled ())
+    return true;
+  if (!usable ())
+    return false;
+
+  uint64_t tsc0, tsc1;
+  NsTime ns0, ns1;
+  sample (tsc0, ns0);
+  do
+    sample (tsc1, ns1);
+  while (ns1 - ns0 < CALIBRATION_TIME);
+  if (tsc1 <= tsc0)
+    return false;
+  double nsPerTick = (double) (ns1 - ns0).ns () / (tsc1 - tsc0);
+  // Sanity check: between 100 MHz and 10 GHz
+  if (nsPerTick > 10.0 || nsPerTick < 0.1)
+    return false;
+
+  originTsc_ = tsc0;
+  originNs_ = ns0.ns ();
+  nsPerTick_ = nsPerTick;
+  checkTicks_ = CHECK_INTERVAL.ns () / nsPerTick;
+  maxDeviation_.store (0, std::memory_order_relaxed);
+  publish (tsc1, ns1.ns (), nsPerTick);
+  enabled_.store (true, std::memory_order_relaxed);
+  return true;
+}
+
+
+// Like now (), but past the check time, where the product of now ()
+// may overflow
+NsTime
+TscClock::extrapolate ()
+{
+  uint64_t tsc, baseTsc, mult;
+  int64_t baseNs;
+  uint32_t seq;
+  do
+    {
+      seq = seq_.load (std::memory_order_acquire);
+      baseTsc = baseTsc_.load (std::memory_order_relaxed);
+      baseNs = baseNs_.load (std::memory_order_relaxed);
+      mult = mult_.load (std::memory_order_relaxed);
+      std::atomic_thread_fence (std::memory_order_acquire);
+      tsc = rdtsc ();
+    }
+  while ((seq & 1) || seq != seq_.load (std::memory_order_relaxed));
+  return NsTime (baseNs
+		 + (int64_t) ((tsc - baseTsc)
+			      * ((double) mult / (1ULL << SHIFT))));
+}
+
+
+NsTime
+TscClock::check ()
+{
+  // Only one thread checks.  The others continue on the current
+  // rate meanwhile, since CLOCK_MONOTONIC may be behind the time they
+  // have already read.
+  if (checking_.exchange (true, std::memory_order_acquire))
+    return extrapolate ();
+
+  uint64_t now;
+  NsTime ns;
+  sample (now, ns);
+  // Extrapolate the way now () does, which may be well past the
+  // check time if no thread has read the clock for a while
+  double rate = (double) mult_.load (std::memory_order_relaxed)
+    / (1ULL << SHIFT);
+  int64_t estimate = baseNs_.load (std::memory_order_relaxed)
+    + (int64_t) ((now - baseTsc_.load (std::memory_order_relaxed)) * rate);
+  int64_t deviation = estimate - ns.ns ();
+  if (llabs (deviation) > maxDeviation_.load (std::memory_order_relaxed))
+    maxDeviation_.store (llabs (deviation), std::memory_order_relaxed);
+  if (llabs (deviation) > MAX_DEVIATION.ns ())
+    {
+      // If the TSC ran ahead, time stands still until CLOCK_MONOTONIC
+      // has caught up with the times already handed out
+      int64_t last = std::max (estimate, ns.ns ());
+      last_.store (last, std::memory_order_relaxed);
+      enabled_.store (false, std::memory_order_release);
+      std::cerr << "RTClock: TSC is " << 1e-3 * deviation
+		<< " us off CLOCK_MONOTONIC, falling back to it\n";
+      checking_.store (false, std::memory_order_release);
+      return NsTime (last);
+    }
+
+  // Refine the rate over the whole time since calibration, then
+  // adjust it so that the deviation is gone at the next check.
+  // Continuing from the estimate keeps time monotonic.
+  nsPerTick_ = (double) (ns.ns () - originNs_) / (now - originTsc_);
+  rate = nsPerTick_ * (1.0 - (double) deviation / CHECK_INTERVAL.ns ());
+  publish (now, estimate, rate);
+  checking_.store (false, std::memory_order_release);
+  return NsTime (estimate);
+}
+
+
+double
+TscClock::frequency ()
+{
+  return nsPerTick_ > 0.0 ? 1e9 / nsPerTick_ : 0.0;
+}
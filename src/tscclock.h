@@ -0,0 +1,159 @@
+/* -*- C++ -*-
+ *  This file is part of spinnaker-adapters
+ *
+ *  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+ *
+ *  libneurosim is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  libneurosim is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TSCCLOCK_H
+#define TSCCLOCK_H
+
+#include <stdint.h>
+#include <atomic>
+#include "nstime.h"
+
+/**
+ * CLOCK_MONOTONIC time computed from the x86 time stamp counter.
+ *
+ * Reading the TSC avoids a vDSO call (or, on some virtual machines,
+ * a system call) per clock reading.  The counter rate is calibrated
+ * against CLOCK_MONOTONIC by enable () and compared to it again
+ * every CHECK_INTERVAL.  Small deviations are slewed away by
+ * adjusting the rate; large ones disable the TSC clock, after which
+ * now () is no longer called by RTClock.
+ *
+ * All members are static since there is one TSC per machine.
+ */
+class TscClock
+{
+ public:
+  // Time between comparisons with CLOCK_MONOTONIC
+  static constexpr NsTime CHECK_INTERVAL = NsTime (1000000000);
+
+  // Deviation from CLOCK_MONOTONIC which disables the TSC clock
+  static constexpr NsTime MAX_DEVIATION = NsTime (1000000);
+
+  /**
+   * Return true if the CPU has an invariant TSC which the kernel
+   * hasn't marked as unstable.
+   */
+  static bool usable ();
+
+  /**
+   * Calibrate and start using the TSC.  Return false if it can't be
+   * used.
+   */
+  static bool enable ();
+
+  /**
+   * Stop using the TSC.
+   */
+  static void disable ()
+  {
+    enabled_.store (false, std::memory_order_relaxed);
+  }
+
+  static bool enabled ()
+  {
+    // Acquire, so that clamp () sees the time when abandoned
+    return enabled_.load (std::memory_order_acquire);
+  }
+
+  /**
+   * Return t, a CLOCK_MONOTONIC reading taken after the TSC clock was
+   * abandoned, or the last TSC time if CLOCK_MONOTONIC hasn't caught
+   * up with it yet.
+   */
+  static NsTime clamp (NsTime t)
+  {
+    int64_t last = last_.load (std::memory_order_relaxed);
+    return t.ns () < last ? NsTime (last) : t;
+  }
+
+  /**
+   * Return the current time on the CLOCK_MONOTONIC scale.
+   */
+  static NsTime now ()
+  {
+    uint64_t tsc, baseTsc, checkAt, mult;
+    int64_t baseNs;
+    uint32_t seq;
+    do
+      {
+	seq = seq_.load (std::memory_order_acquire);
+	baseTsc = baseTsc_.load (std::memory_order_relaxed);
+	baseNs = baseNs_.load (std::memory_order_relaxed);
+	mult = mult_.load (std::memory_order_relaxed);
+	checkAt = checkAt_.load (std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_acquire);
+	// Read after the base, so that tsc >= baseTsc
+	tsc = rdtsc ();
+      }
+    while ((seq & 1) || seq != seq_.load (std::memory_order_relaxed));
+    if (tsc >= checkAt)
+      return check ();
+    // Less than CHECK_INTERVAL has passed, so the product fits
+    return NsTime (baseNs + (int64_t) (((tsc - baseTsc) * mult) >> SHIFT));
+  }
+
+  /**
+   * Return the calibrated TSC frequency in Hz.
+   */
+  static double frequency ();
+
+  /**
+   * Return the largest deviation from CLOCK_MONOTONIC seen.
+   */
+  static NsTime maxDeviation ()
+  {
+    return NsTime (maxDeviation_.load (std::memory_order_relaxed));
+  }
+
+ private:
+  static const int SHIFT = 32;	// mult is ns per tick << SHIFT
+
+  static uint64_t rdtsc ()
+  {
+#if defined (__x86_64__) || defined (__i386__)
+    return __builtin_ia32_rdtsc ();
+#else
+    return 0;
+#endif
+  }
+
+  static void sample (uint64_t& tsc, NsTime& ns);
+  static NsTime check ();
+  static NsTime extrapolate ();
+  static void publish (uint64_t baseTsc, int64_t baseNs, double nsPerTick);
+
+  static std::atomic<bool> enabled_;
+  static std::atomic<bool> checking_;
+  static std::atomic<uint32_t> seq_;
+  static std::atomic<uint64_t> baseTsc_;
+  static std::atomic<int64_t> baseNs_;
+  static std::atomic<uint64_t> mult_;
+  static std::atomic<uint64_t> checkAt_;
+  static uint64_t checkTicks_;
+
+  // Calibration origin, used to refine the rate at each check
+  static uint64_t originTsc_;
+  static int64_t originNs_;
+  static double nsPerTick_;
+  static std::atomic<int64_t> maxDeviation_;
+  static std::atomic<int64_t> last_;	// time when abandoned
+};
+
+#endif /* TSCCLOCK_H */
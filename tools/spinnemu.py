@@ -0,0 +1,368 @@
+#!/usr/bin/env python3
+#
+#  This file is part of spinnaker-adapters
+#
+#  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+#
+#  libneurosim is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  libneurosim is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Stand-in for a SpiNNaker board and the sPyNNaker toolchain.
+
+Talks to spinnmusic-in and spinnmusic-out over loopback UDP the same
+way a real board does: it writes a database describing the
+populations, notifies the adapters on the ports given by --port,
+waits for them to read it, and sends start, pause and stop
+notifications.  While running it emits live output packets for every
+population and counts the spikes injected by the adapters.
+
+Example, 100 neurons firing at 20 Hz for 8 s towards spinnmusic-in
+listening on port 19996:
+
+  tools/spinnemu.py --port 19996 --population pop_forward:100 \\
+      --rate 20 --duration 8
+"""
+
+import argparse
+import math
+import os
+import random
+import select
+import socket
+import sqlite3
+import struct
+import sys
+import tempfile
+import threading
+import time
+
+# EIEIO command ids
+DATABASE_CONFIRMATION = 1
+STOP_PAUSE_NOTIFICATION = 10
+START_RESUME_NOTIFICATION = 11
+
+# EIEIO data packet types
+KEY_32_BIT = 2
+
+# Keys per live output packet, as produced by the live packet gatherer
+MAX_KEYS_PER_PACKET = 63
+
+# Label of the live packet gatherer which owns the output tag
+LPG_LABEL = "LiveSpikeReceiver"
+
+# The database holds the views which the external device library
+# queries, stored as plain tables.
+SCHEMA = """
+CREATE TABLE label_event_atom_view(
+    label TEXT, event INTEGER PRIMARY KEY, atom INTEGER);
+CREATE TABLE app_output_tag_view(
+    pre_vertex_label TEXT, post_vertex_label TEXT, ip_address TEXT,
+    port INTEGER, strip_sdp BOOLEAN, board_address TEXT, tag INTEGER);
+CREATE TABLE app_input_tag_view(
+    application_label TEXT, board_address TEXT, port INTEGER);
+"""
+
+
+def log(msg):
+    sys.stderr.write("EM: " + msg + "\n")
+
+
+def command(cmd):
+    return struct.pack("<H", 0x4000 | cmd)
+
+
+class Population(object):
+    def __init__(self, spec, index, rate, input_port):
+        fields = spec.split(":")
+        if len(fields) < 2 or len(fields) > 3 or not fields[0]:
+            raise ValueError("expected LABEL:N[:RATE], got " + spec)
+        self.label = fields[0]
+        self.n = int(fields[1])
+        if self.n <= 0 or self.n > 0x10000:
+            raise ValueError("bad population size in " + spec)
+        self.rate = float(fields[2]) if len(fields) == 3 else rate
+        self.base_key = (index + 1) << 16
+        self.input_port = input_port
+        self.injected = 0
+        self.emitted = 0
+
+
+def poisson(lam):
+    if lam <= 0.0:
+        return 0
+    if lam > 30.0:
+        return max(0, int(round(random.gauss(lam, math.sqrt(lam)))))
+    limit = math.exp(-lam)
+    k = 0
+    p = random.random()
+    while p > limit:
+        k += 1
+        p *= random.random()
+    return k
+
+
+class Emulator(object):
+    def __init__(self, args):
+        self.args = args
+        self.host = args.host
+        self.pops = [Population(spec, i, args.rate, args.input_port + i)
+                     for i, spec in enumerate(args.population)]
+        self.step = 0
+        self.running = True
+        self.lock = threading.Lock()
+
+        self.notify = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.notify.bind((self.host, args.notify_port))
+        self.out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    # Database
+
+    def write_database(self):
+        fd, path = tempfile.mkstemp(prefix="spinnemu-", suffix=".sqlite3")
+        os.close(fd)
+        db = sqlite3.connect(path)
+        db.executescript(SCHEMA)
+        for pop in self.pops:
+            db.executemany(
+                "INSERT INTO label_event_atom_view VALUES (?, ?, ?)",
+                [(pop.label, pop.base_key + atom, atom)
+                 for atom in range(pop.n)])
+            db.execute(
+                "INSERT INTO app_output_tag_view VALUES (?, ?, ?, ?, ?, ?, ?)",
+                (pop.label, LPG_LABEL, self.host, self.args.output_port,
+                 True, self.host, 1))
+            db.execute(
+                "INSERT INTO app_input_tag_view VALUES (?, ?, ?)",
+                (pop.label, self.host, pop.input_port))
+        db.commit()
+        db.close()
+        return path
+
+    # Notification protocol
+
+    def broadcast(self, cmd):
+        for port in self.args.port:
+            self.notify.sendto(command(cmd), (self.host, port))
+
+    def handshake(self, path):
+        """Notify every listener until it confirms reading the database."""
+        message = command(DATABASE_CONFIRMATION) + path.encode()
+        pending = set(self.args.port)
+        log("waiting for %d listener(s) to read %s" % (len(pending), path))
+        deadline = time.time() + self.args.timeout
+        while pending:
+            if self.args.timeout > 0 and time.time() > deadline:
+                raise RuntimeError("no confirmation from port(s) "
+                                   + ", ".join(map(str, sorted(pending))))
+            for port in pending:
+                self.notify.sendto(message, (self.host, port))
+            ready, _, _ = select.select([self.notify], [], [], 1.0)
+            while ready:
+                data, (host, port) = self.notify.recvfrom(65536)
+                if port in pending and len(data) >= 2:
+                    pending.discard(port)
+                ready, _, _ = select.select([self.notify], [], [], 0.0)
+
+    def wait_for_continue(self):
+        """Resume after every listener sent a packet, or after a delay."""
+        pending = set(self.args.port)
+        deadline = time.time() + self.args.resume
+        while pending:
+            left = deadline - time.time()
+            if left <= 0.0:
+                break
+            ready, _, _ = select.select([self.notify], [], [], left)
+            if ready:
+                data, (host, port) = self.notify.recvfrom(65536)
+                pending.discard(port)
+
+    # Injection
+
+    def receive_loop(self, sock, pop):
+        while self.running:
+            ready, _, _ = select.select([sock], [], [], 0.1)
+            if not ready:
+                continue
+            data = sock.recv(65536)
+            n = self.count_keys(data)
+            with self.lock:
+                pop.injected += n
+
+    @staticmethod
+    def count_keys(data):
+        if len(data) < 2:
+            return 0
+        header, = struct.unpack_from("<H", data)
+        if header >> 14 == 1:
+            return 0          # command packet
+        return header & 0xff
+
+    # Live output
+
+    def fire(self, pop):
+        lam = pop.n * pop.rate * self.args.timestep
+        if self.args.pattern == "poisson":
+            k = min(pop.n, poisson(lam))
+            return [pop.base_key + atom
+                    for atom in random.sample(range(pop.n), k)]
+        if self.args.pattern == "regular":
+            if pop.rate <= 0.0:
+                return []
+            period = max(1, int(round(1.0 / (pop.rate * self.args.timestep))))
+            return [pop.base_key + atom for atom in range(pop.n)
+                    if (self.step + atom) % period == 0]
+        # burst: the whole population fires together
+        if pop.rate > 0.0:
+            period = max(1, int(round(1.0 / (pop.rate * self.args.timestep))))
+            if self.step % period == 0:
+                return [pop.base_key + atom for atom in range(pop.n)]
+        return []
+
+    def emit(self, keys):
+        destination = (self.host, self.args.output_port)
+        for i in range(0, len(keys), MAX_KEYS_PER_PACKET):
+            chunk = keys[i:i + MAX_KEYS_PER_PACKET]
+            # 32 bit keys with a timestamp payload prefix
+            header = len(chunk) | KEY_32_BIT << 10 | 1 << 12 | 1 << 13
+            packet = struct.pack("<HI%dI" % len(chunk),
+                                 header, self.step, *chunk)
+            self.out.sendto(packet, destination)
+
+    def run_segment(self, steps):
+        dt = self.args.timestep
+        start = time.monotonic()
+        late = 0
+        for i in range(steps):
+            target = start + (i + 1) * dt
+            for pop in self.pops:
+                keys = self.fire(pop)
+                if keys:
+                    self.emit(keys)
+                    pop.emitted += len(keys)
+            self.step += 1
+            now = time.monotonic()
+            if now < target:
+                time.sleep(target - now)
+            else:
+                late += 1
+        return time.monotonic() - start, late
+
+    def run(self):
+        receivers = []
+        for pop in self.pops:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.bind((self.host, pop.input_port))
+            t = threading.Thread(target=self.receive_loop, args=(sock, pop))
+            t.daemon = True
+            t.start()
+            receivers.append(t)
+
+        path = self.write_database()
+        try:
+            self.handshake(path)
+            total = int(round(self.args.duration / self.args.timestep))
+            segment = total
+            if self.args.segment > 0.0:
+                segment = max(1, int(round(self.args.segment
+                                           / self.args.timestep)))
+            elapsed = 0.0
+            late = 0
+            done = 0
+            while done < total:
+                steps = min(segment, total - done)
+                log("start at timestep %d" % self.step)
+                self.broadcast(START_RESUME_NOTIFICATION)
+                seconds, n_late = self.run_segment(steps)
+                elapsed += seconds
+                late += n_late
+                done += steps
+                self.broadcast(STOP_PAUSE_NOTIFICATION)
+                log("%s at timestep %d"
+                    % ("stop" if done == total else "pause", self.step))
+                if done < total:
+                    self.wait_for_continue()
+            # Let the last injected packets arrive
+            time.sleep(0.1)
+        finally:
+            self.running = False
+            for t in receivers:
+                t.join()
+            if not self.args.keep:
+                os.remove(path)
+
+        log("%d timesteps in %.3f s, %d late" % (done, elapsed, late))
+        for pop in self.pops:
+            log("%s: emitted %d spikes (%.0f /s), injected %d spikes (%.0f /s)"
+                % (pop.label, pop.emitted, pop.emitted / max(elapsed, 1e-9),
+                   pop.injected, pop.injected / max(elapsed, 1e-9)))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Emulate a SpiNNaker board on loopback UDP")
+    parser.add_argument("-p", "--port", type=int, action="append",
+                        help="database notification port of an adapter "
+                        "(repeatable, default 19999)")
+    parser.add_argument("-P", "--population", action="append", required=True,
+                        help="population LABEL:N[:RATE] (repeatable)")
+    parser.add_argument("-r", "--rate", type=float, default=10.0,
+                        help="live output rate per neuron in Hz "
+                        "(default 10)")
+    parser.add_argument("--pattern", choices=["poisson", "regular", "burst"],
+                        default="poisson",
+                        help="live output firing pattern (default poisson)")
+    parser.add_argument("-t", "--duration", type=float, default=10.0,
+                        help="simulated time in seconds (default 10)")
+    parser.add_argument("--timestep", type=float, default=1e-3,
+                        help="board timestep in seconds (default 1e-3)")
+    parser.add_argument("--segment", type=float, default=0.0,
+                        help="pause after every SEGMENT seconds of "
+                        "simulated time (default never)")
+    parser.add_argument("--resume", type=float, default=0.1,
+                        help="longest wait in seconds before resuming "
+                        "after a pause (default 0.1)")
+    parser.add_argument("--host", default="127.0.0.1",
+                        help="address of the emulated board "
+                        "(default 127.0.0.1)")
+    parser.add_argument("--notify-port", type=int, default=19998,
+                        help="port notifications are sent from "
+                        "(default 19998)")
+    parser.add_argument("--output-port", type=int, default=17895,
+                        help="port live output is sent to (default 17895)")
+    parser.add_argument("--input-port", type=int, default=12345,
+                        help="first injection port; population i listens "
+                        "on INPUT_PORT + i (default 12345)")
+    parser.add_argument("--timeout", type=float, default=0.0,
+                        help="give up if the adapters haven't read the "
+                        "database after TIMEOUT seconds (default never)")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the database file")
+    parser.add_argument("--seed", type=int, help="random seed")
+    args = parser.parse_args()
+    if not args.port:
+        args.port = [19999]
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    try:
+        Emulator(args).run()
+    except (ValueError, RuntimeError, OSError) as e:
+        log(str(e))
+        return 1
+    except KeyboardInterrupt:
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+#  This file is part of spinnaker-adapters
+#
+#  Copyright (C) 2026 Mikael Djurfeldt <mikael@djurfeldt.com>
+#
+#  libneurosim is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  libneurosim is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Print a binary spike log written by spinnmusic-in --record.
+
+By default one line per spike is written in eventlogger style,
+
+  TIME\tID
+
+with TIME the SpiNNaker time in seconds, for the population given by
+--population (default the first one).  With --csv, all populations
+are written as
+
+  label,id,timestep,host_ns
+
+where host_ns is the receive time relative to the first record.  The
+file format is described in src/SpikeLog.h.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"SPNSPIKE"
+VERSION = 1
+RECORD = struct.Struct("=qiI")
+TIMESTEP = 1e-3
+
+
+def read_header(f):
+    if f.read(8) != MAGIC:
+        raise ValueError("not a spike log")
+    version, n = struct.unpack("=II", f.read(8))
+    if version != VERSION:
+        raise ValueError("unsupported spike log version %d" % version)
+    populations = []
+    for _ in range(n):
+        base, size, length = struct.unpack("=III", f.read(12))
+        label = f.read(length).decode()
+        populations.append((label, base, size))
+    return populations
+
+
+def records(f):
+    while True:
+        data = f.read(RECORD.size * 4096)
+        if not data:
+            return
+        # A log cut short by a crash may end in a partial record
+        usable = len(data) - len(data) % RECORD.size
+        for r in RECORD.iter_unpack(data[:usable]):
+            yield r
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Print a spinnmusic-in spike log")
+    parser.add_argument("log", help="spike log file")
+    parser.add_argument("-P", "--population",
+                        help="population to print (default the first)")
+    parser.add_argument("--csv", action="store_true",
+                        help="print all populations as "
+                        "label,id,timestep,host_ns")
+    parser.add_argument("--header", action="store_true",
+                        help="only list the populations")
+    args = parser.parse_args()
+
+    with open(args.log, "rb") as f:
+        try:
+            populations = read_header(f)
+        except (ValueError, struct.error) as e:
+            sys.exit("%s: %s" % (args.log, e))
+        if args.header:
+            for label, base, size in populations:
+                print("%s\t%d\t%d" % (label, base, size))
+            return 0
+        out = sys.stdout
+        if args.csv:
+            out.write("label,id,timestep,host_ns\n")
+            start = None
+            for host, time, key in records(f):
+                if start is None:
+                    start = host
+                for label, base, size in populations:
+                    if base <= key < base + size:
+                        out.write("%s,%d,%d,%d\n"
+                                  % (label, key - base, time, host - start))
+                        break
+            return 0
+        if args.population is None:
+            label, base, size = populations[0]
+        else:
+            matches = [p for p in populations if p[0] == args.population]
+            if not matches:
+                sys.exit("%s: no population %s" % (args.log, args.population))
+            label, base, size = matches[0]
+        for host, time, key in records(f):
+            if base <= key < base + size:
+                out.write("%.6f\t%d\n" % (time * TIMESTEP, key - base))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())